@@ -0,0 +1,81 @@
+#ifndef COMPACT_RECORD_H
+#define COMPACT_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "record.h"
+
+/* Compact in-memory layout of the records.
+ *
+ * A Record reserves 128 bytes for field1 although most values are much shorter, so
+ * most of the memory of a loaded input, and of the bytes a sort moves around, is
+ * padding. A CompactRecord keeps only the numeric fields and the position of field1
+ * in a StringArena, where the strings are stored one after the other, each with its
+ * terminating NUL: 24 bytes per record plus the actual length of the strings.
+ */
+
+/* A record whose field1 is stored in a StringArena. */
+typedef struct {
+    uint64_t field1_offset; // Offset of field1 in the arena
+    uint32_t field1_length; // Length of field1, without the terminating NUL
+    int id;
+    int field2;
+    float field3;
+} CompactRecord;
+
+/* A growable buffer of NUL-terminated strings. */
+typedef struct {
+    char *data;             // The strings (NULL while empty)
+    size_t used;            // Bytes in use
+    size_t capacity;        // Size of the buffer
+} StringArena;
+
+/* The ordering compare_compact_r() sorts records by. */
+typedef struct {
+    size_t field;               // The field index (1, 2 or 3)
+    const StringArena *strings; // The arena holding field1 of the records
+} CompactOrder;
+
+/* Function to get field1 of a compact record.
+ *
+ * @param record  Pointer to the record.
+ * @param strings Pointer to the arena holding its field1.
+ * @return Pointer to the NUL-terminated string, valid until the arena grows.
+ */
+static inline const char *compact_field1(const CompactRecord *record, const StringArena *strings) {
+    return strings->data + record->field1_offset;
+}
+
+/* Function to initialise an empty arena.
+ *
+ * @param strings Pointer to the arena to initialise.
+ */
+void string_arena_init(StringArena *strings);
+
+/* Function to release the memory of an arena, leaving it empty.
+ *
+ * @param strings Pointer to the arena.
+ */
+void string_arena_free(StringArena *strings);
+
+/* Function to convert a record to the compact layout, appending its field1 to an
+ * arena that grows as needed.
+ *
+ * @param compact Pointer to the compact record to fill.
+ * @param record  Pointer to the record to convert.
+ * @param strings Pointer to the arena receiving field1.
+ * @return 0 on success, -1 if the arena cannot grow.
+ */
+int compact_record_set(CompactRecord *compact, const Record *record, StringArena *strings);
+
+/* Function to compare two compact records, in the form taken by merge_sort_r() and
+ * quick_sort_r(). Orders records like compare_record() does for the same field.
+ *
+ * @param a     Pointer to the first record.
+ * @param b     Pointer to the second record.
+ * @param order Pointer to the CompactOrder giving the field and the arena.
+ * @return A negative value, zero or a positive value if a comes before, with or after b.
+ */
+int compare_compact_r(const void *a, const void *b, void *order);
+
+#endif
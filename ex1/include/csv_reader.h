@@ -0,0 +1,102 @@
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+#include <stdio.h>
+#include "compact_record.h"
+#include "record.h"
+
+/* A reader over a memory-mapped CSV file of records.
+ *
+ * Lines are located with memchr and parsed by a specialised scanner instead of
+ * fscanf. Malformed lines are skipped and reported on stderr, and reading goes on
+ * with the next line.
+ */
+typedef struct {
+    const char *data;     // Start of the mapping (NULL for an empty file)
+    size_t length;        // Length of the mapping
+    size_t pos;           // Offset of the next line to parse
+    size_t line;          // Number of the next line, counting from 1
+    size_t malformed;     // Number of malformed lines skipped so far
+    FILE *file;           // The file being read
+} CsvReader;
+
+/* Function to parse one CSV line "id,field1,field2,field3" into a record.
+ *
+ * Accepts the same lines as the fscanf format "%d,%127[^,],%d,%f": numbers may be
+ * preceded by blanks, field1 holds 1 to 127 characters other than commas, and only
+ * blanks may follow the float. Floats whose digits form an integer below 2^24 (so any
+ * 7 significant digits) with a decimal exponent within +-10 are converted with a single
+ * exact float operation, other forms with strtof; both round correctly.
+ *
+ * @param line   Pointer to the first character of the line.
+ * @param end    Pointer just past the last character of the line (excluding '\n').
+ * @param record Pointer to the Record structure to fill with data.
+ * @return 0 on success, -1 if the line is malformed.
+ */
+int parse_record_line(const char *line, const char *end, Record *record);
+
+/* Function to map a file for reading, starting at its current position.
+ *
+ * @param reader Pointer to the reader to initialise.
+ * @param file   Pointer to the file to read; it must be a regular file.
+ * @return 0 on success, -1 if the file cannot be mapped (e.g. a pipe), in which case
+ *         it must be read with read_records() instead.
+ */
+int csv_reader_open(CsvReader *reader, FILE *file);
+
+/* Function to count the lines left to read, an upper bound on the records to come.
+ *
+ * @param reader Pointer to an open reader.
+ * @return The number of lines between the current position and the end of the file.
+ */
+size_t csv_reader_count_lines(const CsvReader *reader);
+
+/* Function to parse the next records, skipping (and reporting) malformed lines and
+ * ignoring blank ones.
+ *
+ * @param reader   Pointer to an open reader.
+ * @param records  Pointer to an array with room for at least `capacity` records.
+ * @param capacity The maximum number of records to read.
+ * @return The number of records read; less than `capacity` only at the end of the file.
+ */
+size_t csv_reader_read(CsvReader *reader, Record *records, size_t capacity);
+
+/* Function to parse all the remaining records into a new array.
+ *
+ * Inputs large enough to be worth it are split into `nthreads` byte ranges that end
+ * at newlines. The lines of every range are counted in parallel, which gives each
+ * range its own slot in a single array, then each thread parses its range straight
+ * into its slot. The slots are finally compacted in range order, so the records keep
+ * the order of the file whatever the number of threads.
+ *
+ * @param reader   Pointer to an open reader.
+ * @param nthreads The number of threads to parse with (0 or 1 to parse sequentially).
+ * @param count    Pointer to where the number of records read is stored.
+ * @return A pointer to the records (to be freed by the caller), or NULL if memory
+ *         runs out.
+ */
+Record *csv_reader_read_all(CsvReader *reader, size_t nthreads, size_t *count);
+
+/* Function to parse all the remaining records into a new array of compact records,
+ * like csv_reader_read_all(). Their field1 strings are stored in a new arena, in the
+ * order of the file.
+ *
+ * @param reader   Pointer to an open reader.
+ * @param nthreads The number of threads to parse with (0 or 1 to parse sequentially).
+ * @param count    Pointer to where the number of records read is stored.
+ * @param strings  Pointer to the arena to create (to be freed by the caller with
+ *                 string_arena_free(), also when no record was read).
+ * @return A pointer to the records (to be freed by the caller), or NULL if memory
+ *         runs out.
+ */
+CompactRecord *csv_reader_read_all_compact(CsvReader *reader, size_t nthreads, size_t *count,
+                                           StringArena *strings);
+
+/* Function to unmap the file, leaving its position at the end. If lines were skipped,
+ * their total is reported on stderr.
+ *
+ * @param reader Pointer to an open reader.
+ */
+void csv_reader_close(CsvReader *reader);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef CSV_WRITER_H
+#define CSV_WRITER_H
+
+#include <stdio.h>
+#include "compact_record.h"
+#include "record.h"
+
+/* Longest CSV line format_record() can produce, including the newline. */
+#define RECORD_LINE_MAX 256
+
+/* A buffered writer of CSV records.
+ *
+ * Lines are formatted by hand into a large buffer, which is handed to the file
+ * descriptor with write() when full instead of going through stdio. If the buffer
+ * cannot be allocated the writer falls back to write_record().
+ */
+typedef struct {
+    FILE *file;           // The file being written
+    int fd;               // Its file descriptor
+    char *buffer;         // Formatted lines not yet written (NULL to use stdio)
+    size_t used;          // Bytes in the buffer
+    size_t capacity;      // Size of the buffer
+    int error;            // Set when a write fails
+} CsvWriter;
+
+/* Function to format a record as the CSV line "id,field1,field2,field3\n".
+ *
+ * The output is byte-for-byte the one of the printf format "%d,%s,%d,%f\n". The float
+ * is formatted exactly: multiplied by 10^6 it still fits a double without rounding, so
+ * rounding that product to an integer half-to-even gives the six decimals of %f.
+ * Values too large for that (and infinities or NaN) go through snprintf.
+ *
+ * @param line   Pointer to a buffer of at least RECORD_LINE_MAX bytes.
+ * @param record Pointer to the record to format.
+ * @return The length of the line, newline included (no terminating NUL is written).
+ */
+size_t format_record(char *line, const Record *record);
+
+/* Function to format a compact record as a CSV line, like format_record().
+ *
+ * @param line    Pointer to a buffer of at least RECORD_LINE_MAX bytes.
+ * @param record  Pointer to the record to format.
+ * @param strings Pointer to the arena holding its field1.
+ * @return The length of the line, newline included (no terminating NUL is written).
+ */
+size_t format_compact_record(char *line, const CompactRecord *record, const StringArena *strings);
+
+/* Function to start writing records to a file at its current position.
+ *
+ * @param writer Pointer to the writer to initialise.
+ * @param file   Pointer to the file to write to; data already buffered in it is flushed.
+ */
+void csv_writer_open(CsvWriter *writer, FILE *file);
+
+/* Function to append a record to the output.
+ *
+ * @param writer Pointer to an open writer.
+ * @param record Pointer to the record to write.
+ */
+void csv_writer_put(CsvWriter *writer, const Record *record);
+
+/* Function to append a compact record to the output.
+ *
+ * @param writer  Pointer to an open writer.
+ * @param record  Pointer to the record to write.
+ * @param strings Pointer to the arena holding its field1.
+ */
+void csv_writer_put_compact(CsvWriter *writer, const CompactRecord *record,
+                            const StringArena *strings);
+
+/* Function to write out the buffered lines and release the buffer. The position of
+ * the file is moved past the written data, so it can still be used through stdio.
+ *
+ * @param writer Pointer to an open writer.
+ * @return 0 on success, -1 if some write failed.
+ */
+int csv_writer_close(CsvWriter *writer);
+
+#endif
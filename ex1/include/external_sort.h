@@ -0,0 +1,27 @@
+#ifndef EXTERNAL_SORT_H
+#define EXTERNAL_SORT_H
+
+#include <stdio.h>
+#include "record.h"
+
+/* Function to sort a CSV file of records using a bounded amount of memory.
+ *
+ * The input, CSV or a binary record file (see record_file.h), is read in chunks that
+ * fit in `options->max_memory` bytes (together with the scratch space of the sort);
+ * each chunk is sorted with sort_record_array() and spilled in binary form as a run
+ * file in `options->tmp_dir`. The runs are then merged k ways with a loser tree,
+ * reading each one through a large buffer; when there are too many runs to merge at
+ * once, groups of them are first merged into longer runs. Ties are resolved in favour
+ * of the earlier run, so with a stable algorithm the output is the same as that of the
+ * in-memory sort. Run files are removed as soon as they are closed. If the whole input
+ * fits in one chunk nothing is spilled.
+ *
+ * @param infile  Pointer to the input file containing records.
+ * @param outfile Pointer to the output file where sorted records will be written.
+ * @param options The sort options; `max_memory` must be non-zero.
+ * @return 0 on success, -1 if memory cannot be allocated or a run file cannot be
+ *         created, written or read.
+ */
+int external_sort_records(FILE *infile, FILE *outfile, const SortOptions *options);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef QUANTILES_H
+#define QUANTILES_H
+
+#include <stdio.h>
+#include "record.h"
+
+/* Function to compute quantiles of a numeric field of the records of a file, without
+ * sorting them.
+ *
+ * Only the keys of the field are loaded (4 bytes per record), streamed from the input
+ * like the external sort does, and all the wanted order statistics are then found in
+ * one multi-select pass (see name_multi_select() in sort_template.h), in expected
+ * linear time. Quantiles follow the nearest-rank definition: the quantile p of n keys
+ * is the ceil(p * n)-th smallest key, and p = 0 gives the smallest one. Keys are
+ * ordered like compare_record() orders the records.
+ *
+ * @param infile        Pointer to the input file containing records.
+ * @param field         The field index (2 or 3).
+ * @param probabilities Array of `count` values between 0 and 1, in any order.
+ * @param count         The number of quantiles to compute.
+ * @param values        Array where the `count` quantiles are stored, in the order of
+ *                      `probabilities` (a double holds any int or float exactly).
+ * @return 0 on success, 1 if the input holds no record, -1 if memory cannot be
+ *         allocated or the input cannot be used.
+ */
+int record_quantiles(FILE *infile, size_t field, const double *probabilities, size_t count,
+                     double *values);
+
+#endif
@@ -10,27 +10,178 @@ typedef struct {
     float field3;
 } Record;
 
-/* Function to set the field to compare records by.
+/* Options controlling how sort_records_with() sorts a file. */
+typedef struct {
+    size_t field;   // The field index to sort by (1 for field1, 2 for field2, 3 for field3)
+    size_t algo;    // The sorting algorithm (0 for automatic selection, 1 for merge sort,
+                    // 2 for quick sort, 3 for tim sort, 4 for multikey string quicksort,
+                    // 5 for in-place merge sort)
+    int indirect;   // Non-zero to sort compact (key, index) pairs instead of whole records
+    size_t threads; // Number of threads for parsing the input and for merge and quick sort
+                    // (0 or 1 for a sequential run)
+    size_t max_memory;   // Memory budget in bytes for an external sort (0 to sort in memory)
+    const char *tmp_dir; // Directory for the external sort run files (NULL for $TMPDIR or /tmp)
+    int compact;    // Non-zero to load CSV input as compact records (see compact_record.h)
+    size_t limit;   // Number of leading records to write, selected with a bounded heap
+                    // (see top_k.h); 0 to write them all
+} SortOptions;
+
+/* A comparison function of two records, as used by qsort(). */
+typedef int (*RecordCompar)(const void *a, const void *b);
+
+/* Function to set the field compare_record() compares records by.
+ *
+ * The field is kept in a global variable, so concurrent sorts on different fields
+ * must use record_comparator() or compare_record_r() instead.
  * 
  * @param field The index of the field to compare (0 for id, 1 for field1, etc.).
  */
 void set_compare_field(int field);
 
-/* Function to read a record from a file.
+/* Function to compare two records by the field selected with set_compare_field().
  * 
- * @param file Pointer to the file to read from.
- * @param record Pointer to the Record structure to fill with data.
- * @return 0 on success, -1 on failure.
+ * @param a Pointer to the first record.
+ * @param b Pointer to the second record.
+ * @return A negative value, zero or a positive value if a comes before, with or after b.
  */
 int compare_record(const void *a, const void *b);
 
+/* Function to get the comparator of one field, which orders records like
+ * compare_record() but does not depend on set_compare_field().
+ *
+ * @param field The field index (1, 2 or 3); any other value gives a comparator that
+ *              considers all records equal.
+ * @return The comparison function.
+ */
+RecordCompar record_comparator(size_t field);
+
+/* Function to compare two records by a field given as context, in the form taken by
+ * merge_sort_r() and quick_sort_r().
+ *
+ * @param a     Pointer to the first record.
+ * @param b     Pointer to the second record.
+ * @param field Pointer to the size_t index of the field to compare.
+ * @return A negative value, zero or a positive value if a comes before, with or after b.
+ */
+int compare_record_r(const void *a, const void *b, void *field);
+
+/* Function to read records from a CSV file, one "id,field1,field2,field3" line each.
+ *
+ * Reading stops at the end of the file, at the first malformed line, or once
+ * `capacity` records have been read, so it can be called again to read the next chunk.
+ *
+ * @param infile   Pointer to the file to read from.
+ * @param records  Pointer to an array with room for at least `capacity` records.
+ * @param capacity The maximum number of records to read.
+ * @return The number of records read.
+ */
+size_t read_records(FILE *infile, Record *records, size_t capacity);
+
+/* Function to write a record to a file as a CSV line.
+ *
+ * @param outfile Pointer to the file to write to.
+ * @param record  Pointer to the record to write.
+ */
+void write_record(FILE *outfile, const Record *record);
+
+/* Function to sort an array of records in place by `options->field`, using the
+ * comparison sort selected by `options->algo` and `options->threads`. The automatic
+ * and string algorithms (0 and 4), which only have an indirect form, use merge sort.
+ * The sequential quick sort of a numeric field sorts packed (key, index) values with
+ * int64_sort() and then moves the records, so it keeps equal records in input order.
+ * The in-place merge sort (algorithm 5) sorts the records themselves, with about
+ * sqrt(count) records of extra memory.
+ * No global state is used, so arrays may be sorted by different fields concurrently.
+ *
+ * @param records Pointer to the first record of the array.
+ * @param count   The number of records in the array.
+ * @param options The sort options (must not be NULL).
+ */
+void sort_record_array(Record *records, size_t count, const SortOptions *options);
+
 /* * Function to sort records from an input file and write them to an output file.
  * 
  * @param infile  Pointer to the input file containing records.
  * @param outfile Pointer to the output file where sorted records will be written.
  * @param field   The field index to sort by (0 for id, 1 for field1, etc.).
- * @param algo    The sorting algorithm to use (0 for merge sort, 1 for quick sort).
+ * @param algo    The sorting algorithm to use (1 for merge sort, 2 for quick sort, 3 for tim sort,
+ *                4 for multikey string quicksort, field 1 only, 5 for in-place merge
+ *                sort). With 0 the algorithm is chosen automatically: an LSD radix sort
+ *                of the keys for the numeric fields 2 and 3, multikey quicksort for
+ *                field 1. Both keep equal records in input order.
  */
 void sort_records(FILE *infile, FILE *outfile, size_t field, size_t algo);
 
+/* Function to sort records from an input file and write them to an output file,
+ * with the behaviour selected by a SortOptions structure.
+ *
+ * In indirect mode only compact (key, record index) pairs are sorted for the numeric
+ * fields, and an array of record pointers for field1; the records are then written
+ * through the resulting permutation without ever being moved. If the index array
+ * cannot be allocated the records are sorted directly instead.
+ *
+ * With a non-zero `max_memory` the file is sorted externally (see external_sort.h),
+ * so inputs larger than the available memory can be sorted. With a non-zero `limit`
+ * only the first `limit` records of the output are selected, in one pass and in
+ * memory proportional to `limit` (see top_k.h); the other options are then ignored.
+ *
+ * In compact mode CSV input is loaded as compact records, whose field1 is kept in a
+ * string arena, which takes a fraction of the memory of whole Records; the indirect
+ * mode does not apply to them.
+ *
+ * A binary record file (see record_file.h, made with csv2bin) is mapped and sorted
+ * without any parsing. Regular input files are memory-mapped and parsed with the CSV
+ * reader of csv_reader.h, which skips malformed lines (reporting them on stderr);
+ * other inputs such as pipes are read with read_records(), which stops at the first
+ * one.
+ *
+ * Like sort_record_array(), this function does not use set_compare_field(), so
+ * several files may be sorted at the same time from different threads.
+ *
+ * @param infile  Pointer to the input file containing records.
+ * @param outfile Pointer to the output file where sorted records will be written.
+ * @param options The sort options (must not be NULL).
+ * @return 0 on success, -1 if the input could not be read or sorted or the output could
+ *         not be written (reported on stderr).
+ */
+int sort_records_with(FILE *infile, FILE *outfile, const SortOptions *options);
+
+/* Function to sort the records of an input file by several fields at once, writing
+ * each ordering to its own output file.
+ *
+ * The input is read once, as by sort_records_with(), and then one thread per field
+ * sorts a permutation of the shared records (radix pairs, string pointers or the
+ * (key, index) pairs of the indirect mode) and writes its file. With the stable
+ * algorithms (all but quick sort) each output is the same as that of
+ * sort_records_with() for its field. `options->threads` is used for
+ * parsing and is then divided among the fields; `field`, `indirect` and `max_memory`
+ * are ignored.
+ *
+ * @param infile   Pointer to the input file containing records.
+ * @param outfiles Array of `nfields` output files, one for each field.
+ * @param fields   Array of the `nfields` field indices to sort by (1, 2 or 3).
+ * @param nfields  The number of orderings to produce.
+ * @param options  The sort options (must not be NULL).
+ * @return 0 on success, -1 if an ordering could not be produced (reported on stderr).
+ */
+int sort_records_multi(FILE *infile, FILE **outfiles, const size_t *fields, size_t nfields,
+                       const SortOptions *options);
+
+/* Function to measure the insertion sort cutoff (see sort_cutoff.h) that makes the
+ * sequential merge and quick sorts of sort_record_array() fastest by a field, on the
+ * leading records of an input file.
+ *
+ * The cutoff is set for the elements those sorts move: abbreviated keys for field1,
+ * whole records for the numeric fields. All the cutoffs set so far, including the new
+ * one, are then written to the output file, from which sort_load_cutoffs() can set
+ * them again in later runs.
+ *
+ * @param infile  Pointer to the input file containing records.
+ * @param outfile Pointer to the file where the cutoffs are written.
+ * @param field   The field index to sort by (1, 2 or 3).
+ * @return 0 on success, -1 if memory cannot be allocated, the input cannot be used or
+ *         the output cannot be written.
+ */
+int calibrate_record_cutoff(FILE *infile, FILE *outfile, size_t field);
+
 #endif
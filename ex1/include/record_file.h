@@ -0,0 +1,73 @@
+#ifndef RECORD_FILE_H
+#define RECORD_FILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "record.h"
+
+/* Binary record files.
+ *
+ * A record file is a RecordFileHeader followed by `count` rows, each a Record exactly
+ * as it is laid out in memory (native byte order, field1 padded with zero bytes). Such
+ * a file can be mapped and sorted in place without any parsing; csv2bin and bin2csv
+ * convert between this format and CSV.
+ */
+
+#define RECORD_FILE_MAGIC "EX1RECS"   // 7 characters and the terminating NUL
+#define RECORD_FILE_VERSION 1
+
+typedef struct {
+    char magic[8];          // RECORD_FILE_MAGIC
+    uint32_t version;       // RECORD_FILE_VERSION
+    uint32_t record_size;   // sizeof(Record), which also catches a foreign byte order
+    uint64_t count;         // Number of rows following the header
+} RecordFileHeader;
+
+/* A record file mapped in memory. */
+typedef struct {
+    Record *records;        // The rows, which may be modified (copy-on-write)
+    size_t count;           // Number of rows
+    void *mapping;          // Start of the mapping
+    size_t length;          // Length of the mapping
+} RecordFile;
+
+/* Function to map a binary record file for reading and sorting.
+ *
+ * The file is mapped privately: records can be sorted in place without touching the
+ * file, and only the pages actually modified are copied. Input that does not start
+ * with the magic string (a CSV file, a pipe) is left untouched.
+ *
+ * @param file Pointer to the record file to fill.
+ * @param in   Pointer to the input file, read from its current position.
+ * @return 0 if the file was mapped, 1 if it is not a binary record file, -1 if it is
+ *         one but cannot be used (wrong version, record size or length, or a field1
+ *         that does not end with a NUL byte), in which case the reason is reported on
+ *         stderr.
+ */
+int record_file_map(RecordFile *file, FILE *in);
+
+/* Function to release a mapped record file.
+ *
+ * @param file Pointer to a record file mapped by record_file_map().
+ */
+void record_file_unmap(RecordFile *file);
+
+/* Function to write the header of a record file.
+ *
+ * @param out   Pointer to the output file.
+ * @param count The number of rows that follow.
+ * @return 0 on success, -1 on a write error.
+ */
+int record_file_write_header(FILE *out, uint64_t count);
+
+/* Function to append rows to a record file. The bytes of field1 after the string are
+ * cleared first, so that converting the same CSV always gives the same file.
+ *
+ * @param out     Pointer to the output file.
+ * @param records Pointer to the records to write.
+ * @param count   The number of records.
+ * @return 0 on success, -1 on a write error.
+ */
+int record_file_append(FILE *out, Record *records, size_t count);
+
+#endif
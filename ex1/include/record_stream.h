@@ -0,0 +1,48 @@
+#ifndef RECORD_STREAM_H
+#define RECORD_STREAM_H
+
+#include <stdio.h>
+#include "csv_reader.h"
+#include "record.h"
+#include "record_file.h"
+
+/* Sequential reading of the records of any input, a chunk at a time.
+ *
+ * A binary record file (see record_file.h) is copied from its mapping, a regular CSV
+ * file is parsed from a mapping by the reader of csv_reader.h, which skips malformed
+ * lines, and other inputs such as pipes are read with read_records(), which stops at
+ * the first one.
+ */
+typedef struct {
+    int kind;             // 0 for a binary record file, 1 for a mapped CSV file, 2 otherwise
+    RecordFile binary;    // The mapped binary file
+    size_t copied;        // Records of the binary file already read
+    CsvReader reader;     // The reader of a mapped CSV file
+    FILE *file;           // The input
+} RecordStream;
+
+/* Function to start reading the records of an input from its current position.
+ *
+ * @param stream Pointer to the stream to initialise.
+ * @param file   Pointer to the input file.
+ * @return 0 on success, -1 if the input is a binary record file that cannot be used
+ *         (the reason is reported on stderr).
+ */
+int record_stream_open(RecordStream *stream, FILE *file);
+
+/* Function to read the next records.
+ *
+ * @param stream   Pointer to an open stream.
+ * @param records  Pointer to an array with room for at least `capacity` records.
+ * @param capacity The maximum number of records to read.
+ * @return The number of records read; less than `capacity` only at the end of the input.
+ */
+size_t record_stream_read(RecordStream *stream, Record *records, size_t capacity);
+
+/* Function to release the mapping of the input, if any.
+ *
+ * @param stream Pointer to an open stream.
+ */
+void record_stream_close(RecordStream *stream);
+
+#endif
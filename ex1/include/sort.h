@@ -1,10 +1,19 @@
 #ifndef SORT_H
 #define SORT_H
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 /** 
  * Sorts the array pointed to by `base` using the merge sort algorithm.
+ *
+ * The sort is stable and runs bottom-up: blocks of a few elements are first sorted by
+ * binary insertion (see sort_cutoff.h for their length), then a single auxiliary
+ * buffer of `nitems` elements is shared by the merge passes, which alternate between
+ * it and `base`. Pairs of runs that are already in order are copied without being
+ * merged. If the buffer cannot be allocated the array is sorted by
+ * inplace_merge_sort() instead.
  * 
  * @param base    A pointer to the first element of the array to sort.
  * @param nitems  The number of elements in the array to sort.
@@ -24,6 +33,14 @@ void merge_sort(void *base, size_t nitems, size_t size, int (*compar)(const void
 
 /** 
  * Sorts the array pointed to by `base` using the quick sort algorithm.
+ *
+ * Pivots are chosen by median of three (Tukey's ninther on large ranges) and each
+ * range is split three ways, so runs of keys equal to the pivot are finished in a
+ * single pass. Only the smaller partition is recursed into, and ranges that exceed
+ * about 2 * log2(n) levels of partitioning are finished with heap sort, so the worst
+ * case is O(n log n). Short ranges are finished with binary insertion sort (see
+ * sort_cutoff.h).
+ * The sort is not stable.
  * 
  * @param base    A pointer to the first element of the array to sort.
  * @param nitems  The number of elements in the array to sort.
@@ -41,4 +58,212 @@ void merge_sort(void *base, size_t nitems, size_t size, int (*compar)(const void
  */
 void quick_sort(void *base, size_t nitems, size_t size, int (*compar)(const void *, const void *));
 
+/**
+ * Variants of merge_sort() and quick_sort() whose comparison function takes a third
+ * argument, like qsort_r(): `ctx` is passed to every call of `compar`. The ordering
+ * can thus depend on parameters without global state, and sorts with different
+ * parameters can run at the same time in different threads.
+ *
+ * @param base    A pointer to the first element of the array to sort.
+ * @param nitems  The number of elements in the array to sort.
+ * @param size    The size in bytes of each element in the array.
+ * @param compar  A pointer to a comparison function, called as compar(a, b, ctx), with
+ *                the same result convention as for merge_sort().
+ * @param ctx     The context argument passed to `compar` (may be NULL).
+ */
+void merge_sort_r(void *base, size_t nitems, size_t size,
+                  int (*compar)(const void *, const void *, void *), void *ctx);
+void quick_sort_r(void *base, size_t nitems, size_t size,
+                  int (*compar)(const void *, const void *, void *), void *ctx);
+
+/**
+ * Sorts the array pointed to by `base` using a stable merge sort that needs only
+ * O(sqrt(n)) elements of extra memory, instead of the `nitems` of merge_sort().
+ *
+ * Blocks sorted by binary insertion (see sort_cutoff.h) are merged bottom-up in place.
+ * Runs are merged through a buffer of about sqrt(nitems) elements once one of them
+ * fits in it; longer runs are first split with SymMerge (Kim and Kutzner): a binary
+ * search finds the blocks that must change places around the middle, which are
+ * rotated, leaving two smaller merges. That takes O(n log n) comparisons and
+ * O(n log^2 n) moves in the worst case, so the sort is slower than merge_sort() but
+ * fits where memory is short. If the buffer cannot be allocated the merges use
+ * rotations instead, so the array is always sorted.
+ *
+ * @param base    A pointer to the first element of the array to sort.
+ * @param nitems  The number of elements in the array to sort.
+ * @param size    The size in bytes of each element in the array.
+ * @param compar  A pointer to a comparison function that determines the sort order,
+ *                with the same contract as for merge_sort().
+ */
+void inplace_merge_sort(void *base, size_t nitems, size_t size,
+                        int (*compar)(const void *, const void *));
+
+/**
+ * Variant of inplace_merge_sort() whose comparison function takes a context argument,
+ * like merge_sort_r().
+ */
+void inplace_merge_sort_r(void *base, size_t nitems, size_t size,
+                          int (*compar)(const void *, const void *, void *), void *ctx);
+
+/** 
+ * Sorts the array pointed to by `base` using the TimSort algorithm.
+ *
+ * TimSort is a stable, adaptive merge sort: it detects the ascending and strictly
+ * descending runs already present in the input (reversing the latter), extends short
+ * runs with binary insertion sort, and merges them with galloping. Sorted, reverse
+ * sorted and nearly sorted inputs are handled in close to linear time, while the
+ * worst case stays O(n log n). Up to `nitems / 2` elements of scratch space are
+ * allocated; if that fails the array is sorted by inplace_merge_sort() instead.
+ * 
+ * @param base    A pointer to the first element of the array to sort.
+ * @param nitems  The number of elements in the array to sort.
+ * @param size    The size in bytes of each element in the array.
+ * @param compar  A pointer to a comparison function that determines the sort order,
+ *                with the same contract as for merge_sort().
+ */
+void tim_sort(void *base, size_t nitems, size_t size, int (*compar)(const void *, const void *));
+
+/**
+ * Sorts the array pointed to by `base` using a multithreaded merge sort.
+ *
+ * The recursion is split into tasks for a work-stealing thread pool down to a grain
+ * size, below which ranges are sorted with merge_sort(). Large merges are split into
+ * independent slices of the output, located in both inputs by binary search on their
+ * co-ranks, so the top levels are merged in parallel too. The sort is stable and
+ * produces exactly the same result as merge_sort(). With `nthreads` <= 1, on small
+ * arrays, or if the buffer or the threads cannot be obtained, merge_sort() is used.
+ *
+ * @param base     A pointer to the first element of the array to sort.
+ * @param nitems   The number of elements in the array to sort.
+ * @param size     The size in bytes of each element in the array.
+ * @param compar   A pointer to a comparison function that determines the sort order,
+ *                 with the same contract as for merge_sort(). It is called concurrently
+ *                 from several threads.
+ * @param nthreads The number of threads to use, including the calling one.
+ */
+void parallel_merge_sort(void *base, size_t nitems, size_t size,
+                         int (*compar)(const void *, const void *), size_t nthreads);
+
+/**
+ * Sorts the array pointed to by `base` using a multithreaded sample sort.
+ *
+ * Splitters are picked from a sorted random sample of the input, oversampled so that
+ * the buckets come out balanced. Each thread classifies a block of the input into the
+ * buckets in a single pass, the elements are scattered into contiguous buckets, and
+ * the buckets are then sorted independently in parallel with quick_sort(). Keys equal
+ * to a splitter get a bucket of their own that needs no sorting, and buckets that still
+ * come out much bigger than expected are split again. The sort is not stable. With
+ * `nthreads` <= 1, on small arrays, or if the buffer or the threads cannot be obtained,
+ * quick_sort() is used.
+ *
+ * @param base     A pointer to the first element of the array to sort.
+ * @param nitems   The number of elements in the array to sort.
+ * @param size     The size in bytes of each element in the array.
+ * @param compar   A pointer to a comparison function that determines the sort order,
+ *                 with the same contract as for quick_sort(). It is called concurrently
+ *                 from several threads.
+ * @param nthreads The number of threads to use, including the calling one.
+ */
+void sample_sort(void *base, size_t nitems, size_t size,
+                 int (*compar)(const void *, const void *), size_t nthreads);
+
+/**
+ * Sorts an array of pointers to NUL-terminated strings using multikey quicksort
+ * (three-way radix quicksort).
+ *
+ * Each step partitions on a single character into less, equal and greater groups,
+ * and only the equal group moves on to the next character, so shared prefixes are
+ * not scanned again for every comparison as with strcmp. Small groups are finished
+ * with insertion sort. Strings are ordered as by strcmp; equal strings end up in
+ * increasing address order, so pointers into a single array of records keep their
+ * original relative order (the sort is stable in that case).
+ *
+ * @param strings A pointer to the first element of the array of string pointers.
+ * @param nitems  The number of strings in the array.
+ */
+void string_sort(const char **strings, size_t nitems);
+
+/**
+ * An element sorted by radix_sort_pairs(): an order-preserving 32-bit key and the
+ * position of the item it was extracted from.
+ */
+typedef struct {
+    uint32_t key;
+    uint32_t index;
+} RadixPair;
+
+/**
+ * Maps an int to an unsigned key with the same order, by flipping the sign bit.
+ */
+static inline uint32_t radix_key_int(int value) {
+    return (uint32_t)value ^ 0x80000000u;
+}
+
+/**
+ * Maps a float to an unsigned key with the same order as the `<` operator: the sign
+ * bit is flipped for positive values and every bit for negative ones. -0.0 is mapped
+ * to the same key as +0.0, since the two compare equal.
+ */
+static inline uint32_t radix_key_float(float value) {
+    uint32_t bits;
+    if (value == 0.0f) value = 0.0f;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+/**
+ * Sorts an array of (key, index) pairs by key using an LSD radix sort with 11-bit
+ * digits (three passes at most; passes where every key has the same digit are
+ * skipped). The sort is stable and runs in O(n) time.
+ *
+ * @param pairs   A pointer to the first pair of the array to sort.
+ * @param nitems  The number of pairs in the array.
+ * @return 0 on success, -1 if the auxiliary buffer cannot be allocated (the array is
+ *         then left unchanged).
+ */
+int radix_sort_pairs(RadixPair *pairs, size_t nitems);
+
+/**
+ * Packs an order-preserving key (see radix_key_int() and radix_key_float()) and an
+ * index into a 64-bit integer that orders like the key, then like the index. Since
+ * the indices of an array are distinct, sorting such values with int64_sort() gives
+ * the same order as a stable sort of the keys.
+ */
+static inline int64_t int64_key_pair(uint32_t key, uint32_t index) {
+    return (int64_t)(((uint64_t)(key ^ 0x80000000u) << 32) | index);
+}
+
+/**
+ * The index packed by int64_key_pair().
+ */
+static inline uint32_t int64_key_index(int64_t value) {
+    return (uint32_t)value;
+}
+
+/**
+ * Sorts an array of 64-bit signed integers with an introsort made for them.
+ *
+ * The partition follows BlockQuicksort: blocks of values are compared to the pivot
+ * without branches, recording the offsets of the values on the wrong side, which are
+ * then swapped in pairs, so random data causes no branch mispredictions. Ranges of at
+ * most 64 values are finished with an AVX2 bitonic sorting network when the CPU
+ * supports it (checked at run time), and with binary insertion sort otherwise (see
+ * sort_cutoff.h). The sort is not stable, which does not matter for values that are
+ * all distinct, like those of int64_key_pair().
+ *
+ * @param values A pointer to the first value of the array to sort.
+ * @param nitems The number of values in the array.
+ */
+void int64_sort(int64_t *values, size_t nitems);
+
+/**
+ * Chooses whether int64_sort() uses the AVX2 kernels on CPUs that support them (the
+ * default), for instance to compare them with the scalar ones. It must not be called
+ * while sorts run in other threads.
+ *
+ * @param enable Non-zero to use the AVX2 kernels when available, 0 for the scalar ones.
+ * @return Non-zero if the AVX2 kernels are now used.
+ */
+int int64_sort_set_avx2(int enable);
+
 #endif // SORT_H
@@ -0,0 +1,72 @@
+#ifndef SORT_CUTOFF_H
+#define SORT_CUTOFF_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Insertion sort cutoffs of the comparison sorts.
+ *
+ * merge_sort(), quick_sort(), their _r variants and the kernels of sort_template.h
+ * finish short ranges with binary insertion sort: the merge sorts sort blocks of
+ * `cutoff` elements before the first merge pass, the quick sorts stop partitioning
+ * ranges of at most `cutoff` elements. The best cutoff depends on how expensive moves
+ * are compared to comparisons, and on the caches of the machine, so it is kept per
+ * element size. A built-in guess is used for sizes that have not been set;
+ * sort_calibrate_cutoff() measures the best one on the current machine, and the table
+ * can be saved to a file and loaded back.
+ *
+ * The table is read by every sort without locking, so it must not be changed while
+ * sorts run in other threads.
+ */
+
+// Largest cutoff that can be set
+#define SORT_CUTOFF_MAX 256
+
+/* Function to get the cutoff used for elements of a given size.
+ *
+ * @param size The size in bytes of the elements.
+ * @return The cutoff; 1 means no insertion sort.
+ */
+size_t sort_cutoff(size_t size);
+
+/* Function to set the cutoff used for elements of a given size.
+ *
+ * @param size   The size in bytes of the elements.
+ * @param cutoff The cutoff, at most SORT_CUTOFF_MAX (0 and 1 both disable insertion
+ *               sort).
+ * @return 0 on success, -1 if the cutoff is too large or the table is full.
+ */
+int sort_set_cutoff(size_t size, size_t cutoff);
+
+/* Function to forget every cutoff that was set, going back to the built-in guesses. */
+void sort_reset_cutoffs(void);
+
+/* Function to measure the best cutoff for an element size and comparison function, and
+ * to set it.
+ *
+ * Each candidate cutoff is timed with `bench`, which should sort a copy of the data
+ * the way the program does (`bench` is called several times per candidate and the
+ * fastest run counts). The candidate with the lowest time is set and returned.
+ *
+ * @param size  The size in bytes of the elements the cutoff is for.
+ * @param bench A function that runs one timed sort, with the cutoff already set.
+ * @param ctx   The argument passed to `bench`.
+ * @return The chosen cutoff.
+ */
+size_t sort_calibrate_cutoff(size_t size, void (*bench)(void *ctx), void *ctx);
+
+/* Function to write the cutoffs that were set, one "size,cutoff" line each.
+ *
+ * @param file Pointer to the output file.
+ * @return 0 on success, -1 on a write error.
+ */
+int sort_save_cutoffs(FILE *file);
+
+/* Function to set the cutoffs read from a file written by sort_save_cutoffs().
+ *
+ * @param file Pointer to the input file.
+ * @return 0 on success, -1 if a line cannot be parsed or a cutoff cannot be set.
+ */
+int sort_load_cutoffs(FILE *file);
+
+#endif
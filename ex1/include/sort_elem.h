@@ -0,0 +1,139 @@
+#ifndef SORT_ELEM_H
+#define SORT_ELEM_H
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Element moves for the generic sorts, specialised on the element size.
+ *
+ * The sorts of sort.h only know the size of their elements at run time, so a plain
+ * memcpy(dst, src, size) is a call into the library for every move. These helpers
+ * test the size first and use a memcpy of a constant size for the common ones,
+ * which the compiler turns into a few register moves: 4, 8 and 16 bytes (ints,
+ * pointers, the (key, index) pairs of the indirect mode) and ELEM_RECORD_SIZE.
+ * Other multiples of 8 are swapped one 8-byte word at a time, and anything else
+ * through a fixed-size stack buffer, so that no variable-length array is needed.
+ */
+
+// Bytes swapped at a time through the stack buffer of elem_swap()
+#define ELEM_SWAP_CHUNK 64
+// Size of the records of record.h, the largest elements sorted by the program (checked
+// in record.c); the moves are specialised on it without depending on the Record type
+#define ELEM_RECORD_SIZE 140
+// Largest element the sorts keep in a scratch slot on the stack; larger ones allocate it
+#define ELEM_STACK_MAX 160
+
+/**
+ * Copies one element of `size` bytes from src to dst (which must not overlap).
+ */
+static inline void elem_copy(void *dst, const void *src, size_t size) {
+    if (size == ELEM_RECORD_SIZE)
+        memcpy(dst, src, ELEM_RECORD_SIZE);
+    else if (size == 8)
+        memcpy(dst, src, 8);
+    else if (size == 4)
+        memcpy(dst, src, 4);
+    else if (size == 16)
+        memcpy(dst, src, 16);
+    else
+        memcpy(dst, src, size);
+}
+
+// Swap the first nwords 8-byte words of pa and pb
+static inline void elem_swap_words(char *pa, char *pb, size_t nwords) {
+    for (size_t k = 0; k < nwords; k++) {
+        uint64_t wa, wb;
+        memcpy(&wa, pa + 8 * k, 8);
+        memcpy(&wb, pb + 8 * k, 8);
+        memcpy(pa + 8 * k, &wb, 8);
+        memcpy(pb + 8 * k, &wa, 8);
+    }
+}
+
+/**
+ * Swaps two elements of `size` bytes.
+ */
+static inline void elem_swap(void *a, void *b, size_t size) {
+    char *pa = (char *)a, *pb = (char *)b;
+    if (size == ELEM_RECORD_SIZE) {
+        char tmp[ELEM_RECORD_SIZE];
+        memcpy(tmp, pa, ELEM_RECORD_SIZE);
+        memcpy(pa, pb, ELEM_RECORD_SIZE);
+        memcpy(pb, tmp, ELEM_RECORD_SIZE);
+    } else if (size == 8) {
+        elem_swap_words(pa, pb, 1);
+    } else if (size == 4) {
+        uint32_t wa, wb;
+        memcpy(&wa, pa, 4);
+        memcpy(&wb, pb, 4);
+        memcpy(pa, &wb, 4);
+        memcpy(pb, &wa, 4);
+    } else if (size == 16) {
+        elem_swap_words(pa, pb, 2);
+    } else if (size % 8 == 0) {
+        elem_swap_words(pa, pb, size / 8);
+    } else {
+        char tmp[ELEM_SWAP_CHUNK];
+        for (size_t offset = 0; offset < size; offset += ELEM_SWAP_CHUNK) {
+            size_t n = size - offset < ELEM_SWAP_CHUNK ? size - offset : ELEM_SWAP_CHUNK;
+            memcpy(tmp, pa + offset, n);
+            memcpy(pa + offset, pb + offset, n);
+            memcpy(pb + offset, tmp, n);
+        }
+    }
+}
+
+/**
+ * A comparison function of either the qsort() or the qsort_r() kind, so that one
+ * implementation of a sort serves both its plain and its _r variant.
+ */
+typedef struct {
+    int (*compar)(const void *, const void *);
+    int (*compar_r)(const void *, const void *, void *);  // Used instead if not NULL
+    void *ctx;                                            // Third argument of compar_r
+} SortCompar;
+
+/**
+ * Compares two elements with a SortCompar.
+ */
+static inline int sort_compare(const SortCompar *cmp, const void *a, const void *b) {
+    return cmp->compar_r ? cmp->compar_r(a, b, cmp->ctx) : cmp->compar(a, b);
+}
+
+/**
+ * Sorts the `nitems` elements at arr by binary insertion. Each element is placed after
+ * the equal ones before it, so the sort is stable. `tmp` must have room for one element.
+ */
+static inline void elem_insertion_sort(char *arr, size_t nitems, size_t size,
+                                       const SortCompar *cmp, char *tmp) {
+    for (size_t i = 1; i < nitems; i++) {
+        char *item = arr + i * size;
+        // Already in place: the common case on runs that are partly sorted
+        if (sort_compare(cmp, item - size, item) <= 0) continue;
+
+        // Find the rightmost position in arr[0 .. i - 1) where the item can go
+        size_t left = 0, right = i - 1;
+        while (left < right) {
+            size_t mid = left + (right - left) / 2;
+            if (sort_compare(cmp, item, arr + mid * size) < 0)
+                right = mid;
+            else
+                left = mid + 1;
+        }
+
+        elem_copy(tmp, item, size);
+        memmove(arr + (left + 1) * size, arr + left * size, size * (i - left));
+        elem_copy(arr + left * size, tmp, size);
+    }
+}
+
+/**
+ * Sorts the `nitems` (at least two) elements at base with the stable in-place merge sort
+ * of inplace_merge_sort(). It never fails: without memory for its buffer it merges by
+ * rotations alone, so the other sorts fall back to it when their buffers cannot be
+ * allocated.
+ */
+void inplace_merge_sort_with(void *base, size_t nitems, size_t size, const SortCompar *cmp);
+
+#endif // SORT_ELEM_H
@@ -0,0 +1,375 @@
+#ifndef SORT_TEMPLATE_H
+#define SORT_TEMPLATE_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sort_cutoff.h"
+
+/**
+ * Defines sort kernels specialised for one element type and ordering:
+ *
+ *     static void name_merge_sort(type *base, size_t nitems);
+ *     static void name_quick_sort(type *base, size_t nitems);
+ *     static void name_multi_select(type *base, size_t nitems, const size_t *ranks,
+ *                                   size_t nranks);
+ *
+ * They follow merge_sort() and quick_sort() (a stable bottom-up merge sort, and an
+ * introsort with ninther pivots and a heap sort fallback), but elements are moved by
+ * assignment and compared by `less_expr` inlined in place, instead of through memcpy()
+ * of a runtime size and calls through a function pointer. Since only `less` is known,
+ * the quick sort partitions like Hoare rather than three ways; keys equal to the pivot
+ * are still skipped in one pass when the key just before the range equals the pivot.
+ * Both finish short ranges with binary insertion sort, below the cutoff that
+ * sort_cutoff() gives for sizeof(type).
+ *
+ * name_multi_select() moves the elements of the given ranks (0 for the smallest, which
+ * must be sorted ascending and below nitems) to their sorted positions, with no greater
+ * element before each of them and no smaller one after, in expected linear time for a
+ * few ranks. It selects the middle rank with Floyd-Rivest and recurses on both sides
+ * with the ranks that fall there; like the quick sort it falls back to heap sort on a
+ * range once its depth limit runs out (introselect). Its users must link with -lm.
+ *
+ * The functions are `static inline`, so a translation unit may use only some of them.
+ * Like merge_sort(), name_merge_sort() sorts in place if its buffer cannot be
+ * allocated: the runs are then merged by SymMerge with rotations, which is slower but
+ * still stable and needs no memory.
+ *
+ * @param name      Prefix of the generated functions.
+ * @param type      The element type (a single identifier or a typedef name for pointer
+ *                  types, since it is used as `type *` and `const type *`).
+ * @param less_expr An expression of the `const type *` pointers `a` and `b`, true when
+ *                  *a must come before *b (a strict weak ordering, like `<`).
+ */
+#define SORT_DEFINE(name, type, less_expr)                                                  \
+    static inline int name##_less(const type *a, const type *b) {                           \
+        return (less_expr);                                                                 \
+    }                                                                                       \
+                                                                                            \
+    /* Merge the sorted runs left[0..left_count) and right[0..right_count) into dest */     \
+    static inline void name##_merge(type *dest, const type *left, size_t left_count,        \
+                                    const type *right, size_t right_count) {                \
+        if (!name##_less(right, left + left_count - 1)) {                                   \
+            memcpy(dest, left, sizeof(type) * left_count);                                  \
+            memcpy(dest + left_count, right, sizeof(type) * right_count);                   \
+            return;                                                                         \
+        }                                                                                   \
+        size_t i = 0, j = 0, k = 0;                                                         \
+        while (i < left_count && j < right_count) {                                         \
+            if (name##_less(right + j, left + i))                                           \
+                dest[k++] = right[j++];                                                     \
+            else                                                                            \
+                dest[k++] = left[i++];                                                      \
+        }                                                                                   \
+        memcpy(dest + k, left + i, sizeof(type) * (left_count - i));                        \
+        k += left_count - i;                                                                \
+        memcpy(dest + k, right + j, sizeof(type) * (right_count - j));                      \
+    }                                                                                       \
+                                                                                            \
+    /* Stable binary insertion sort of arr[0..nitems) */                                   \
+    static inline void name##_insertion_sort(type *arr, size_t nitems) {                    \
+        for (size_t i = 1; i < nitems; i++) {                                               \
+            if (!name##_less(arr + i, arr + i - 1)) continue;                               \
+            size_t left = 0, right = i - 1;                                                 \
+            while (left < right) {                                                          \
+                size_t mid = left + (right - left) / 2;                                     \
+                if (name##_less(arr + i, arr + mid))                                        \
+                    right = mid;                                                            \
+                else                                                                        \
+                    left = mid + 1;                                                         \
+            }                                                                               \
+            type item = arr[i];                                                             \
+            memmove(arr + left + 1, arr + left, sizeof(type) * (i - left));                 \
+            arr[left] = item;                                                               \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    static inline void name##_swap(type *a, type *b) {                                      \
+        type tmp = *a;                                                                      \
+        *a = *b;                                                                            \
+        *b = tmp;                                                                           \
+    }                                                                                       \
+                                                                                            \
+    /* Reverse arr[0..nitems) */                                                            \
+    static inline void name##_reverse(type *arr, size_t nitems) {                           \
+        for (size_t i = 0, j = nitems; i + 1 < j; i++, j--) {                               \
+            name##_swap(arr + i, arr + j - 1);                                              \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    /* Stable merge of the sorted runs arr[lo..mid) and arr[mid..hi) without a buffer */    \
+    /* (SymMerge): a binary search finds the blocks that change places around the */        \
+    /* middle, they are rotated by three reversals, and both halves are merged */           \
+    static inline void name##_symmerge(type *arr, size_t lo, size_t mid, size_t hi) {       \
+        if (lo == mid || mid == hi || !name##_less(arr + mid, arr + mid - 1)) return;       \
+        size_t half = lo + (hi - lo) / 2, n = half + mid;                                   \
+        size_t start = mid > half ? n - hi : lo, end = mid > half ? half : mid;             \
+        while (start < end) {                                                               \
+            size_t c = start + (end - start) / 2;                                           \
+            if (!name##_less(arr + n - 1 - c, arr + c))                                     \
+                start = c + 1;                                                              \
+            else                                                                            \
+                end = c;                                                                    \
+        }                                                                                   \
+        end = n - start;                                                                    \
+        if (start < mid && mid < end) {                                                     \
+            name##_reverse(arr + start, mid - start);                                       \
+            name##_reverse(arr + mid, end - mid);                                           \
+            name##_reverse(arr + start, end - start);                                       \
+        }                                                                                   \
+        name##_symmerge(arr, lo, start, half);                                              \
+        name##_symmerge(arr, half, end, hi);                                                \
+    }                                                                                       \
+                                                                                            \
+    /* Merge sort in place, used when the buffer of the merge sort cannot be allocated */   \
+    static inline void name##_inplace_merge_sort(type *base, size_t nitems) {               \
+        size_t cutoff = sort_cutoff(sizeof(type));                                          \
+        for (size_t low = 0; cutoff > 1 && low < nitems; low += cutoff) {                   \
+            size_t count = nitems - low < cutoff ? nitems - low : cutoff;                   \
+            name##_insertion_sort(base + low, count);                                       \
+        }                                                                                   \
+        for (size_t width = cutoff; width < nitems; width *= 2) {                           \
+            for (size_t low = 0; low + width < nitems; low += 2 * width) {                  \
+                size_t high = low + 2 * width < nitems ? low + 2 * width : nitems;          \
+                name##_symmerge(base, low, low + width, high);                              \
+            }                                                                               \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    /* Bottom-up merge sort alternating between the array and one buffer, starting */      \
+    /* from blocks sorted by insertion */                                                   \
+    static inline void name##_merge_sort(type *base, size_t nitems) {                       \
+        if (nitems < 2 || base == NULL) return;                                             \
+        type *buffer = malloc(sizeof(type) * nitems);                                       \
+        if (!buffer) {                                                                      \
+            name##_inplace_merge_sort(base, nitems);                                        \
+            return;                                                                         \
+        }                                                                                   \
+                                                                                            \
+        type *src = base;                                                                   \
+        type *dst = buffer;                                                                 \
+        size_t cutoff = sort_cutoff(sizeof(type));                                          \
+        for (size_t low = 0; cutoff > 1 && low < nitems; low += cutoff) {                   \
+            size_t count = nitems - low < cutoff ? nitems - low : cutoff;                   \
+            name##_insertion_sort(src + low, count);                                        \
+        }                                                                                   \
+        for (size_t width = cutoff; width < nitems; width *= 2) {                           \
+            for (size_t low = 0; low < nitems; low += 2 * width) {                          \
+                size_t mid = low + width < nitems ? low + width : nitems;                   \
+                size_t high = low + 2 * width < nitems ? low + 2 * width : nitems;          \
+                if (mid == high)                                                            \
+                    memcpy(dst + low, src + low, sizeof(type) * (high - low));              \
+                else                                                                        \
+                    name##_merge(dst + low, src + low, mid - low, src + mid, high - mid);   \
+            }                                                                               \
+            type *tmp = src;                                                                \
+            src = dst;                                                                      \
+            dst = tmp;                                                                      \
+        }                                                                                   \
+        if (src != base) memcpy(base, src, sizeof(type) * nitems);                          \
+        free(buffer);                                                                       \
+    }                                                                                       \
+                                                                                            \
+    /* Index of the median of the elements at indices a, b and c */                         \
+    static inline size_t name##_median_of_three(const type *arr, size_t a, size_t b,        \
+                                                size_t c) {                                 \
+        if (name##_less(arr + a, arr + b)) {                                                \
+            if (name##_less(arr + b, arr + c)) return b;                                    \
+            return name##_less(arr + a, arr + c) ? c : a;                                   \
+        }                                                                                   \
+        if (name##_less(arr + a, arr + c)) return a;                                        \
+        return name##_less(arr + b, arr + c) ? c : b;                                       \
+    }                                                                                       \
+                                                                                            \
+    /* Restore the max-heap property for the subtree rooted at index root */                \
+    static inline void name##_sift_down(type *arr, size_t root, size_t nitems) {            \
+        size_t child;                                                                       \
+        while ((child = 2 * root + 1) < nitems) {                                           \
+            if (child + 1 < nitems && name##_less(arr + child, arr + child + 1)) child++;   \
+            if (!name##_less(arr + root, arr + child)) return;                              \
+            name##_swap(arr + root, arr + child);                                           \
+            root = child;                                                                   \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    static inline void name##_heap_sort(type *arr, size_t nitems) {                         \
+        for (size_t i = nitems / 2; i > 0; i--) name##_sift_down(arr, i - 1, nitems);       \
+        for (size_t end = nitems - 1; end > 0; end--) {                                     \
+            name##_swap(arr, arr + end);                                                    \
+            name##_sift_down(arr, 0, end);                                                  \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    /* Move a median of three (ninther on long ranges) to arr[0] as the pivot */            \
+    static inline void name##_choose_pivot(type *arr, size_t nitems) {                      \
+        size_t mid = nitems / 2, high = nitems - 1, pivot_index;                            \
+        if (nitems >= 128) {                                                                \
+            size_t step = nitems / 8;                                                       \
+            pivot_index = name##_median_of_three(                                           \
+                arr, name##_median_of_three(arr, 0, step, 2 * step),                        \
+                name##_median_of_three(arr, mid - step, mid, mid + step),                   \
+                name##_median_of_three(arr, high - 2 * step, high - step, high));           \
+        } else {                                                                            \
+            pivot_index = name##_median_of_three(arr, 0, mid, high);                        \
+        }                                                                                   \
+        name##_swap(arr, arr + pivot_index);                                                \
+    }                                                                                       \
+                                                                                            \
+    /* Hoare partition around the pivot in arr[0]. Both scans stop on keys equal to */      \
+    /* the pivot, so runs of equal keys are split evenly. Returns the final index of */     \
+    /* the pivot: the keys before it are not greater, the keys after it not smaller. */     \
+    static inline size_t name##_partition(type *arr, size_t nitems) {                       \
+        type pivot = arr[0];                                                                \
+        size_t i = 0, j = nitems;                                                           \
+        for (;;) {                                                                          \
+            while (++i < nitems && name##_less(arr + i, &pivot)) {}                         \
+            while (name##_less(&pivot, arr + --j)) {}                                       \
+            if (i >= j) break;                                                              \
+            name##_swap(arr + i, arr + j);                                                  \
+        }                                                                                   \
+        name##_swap(arr, arr + j);                                                          \
+        return j;                                                                           \
+    }                                                                                       \
+                                                                                            \
+    /* Partition used when the pivot in arr[0] equals the key just before the range, */     \
+    /* which no key of the range is smaller than: the keys equal to the pivot are put */    \
+    /* first and are done. Returns the index of the last of them. */                        \
+    static inline size_t name##_partition_equal(type *arr, size_t nitems) {                 \
+        type pivot = arr[0];                                                                \
+        size_t i = 0, j = nitems;                                                           \
+        for (;;) {                                                                          \
+            while (++i < j && !name##_less(&pivot, arr + i)) {}                             \
+            while (name##_less(&pivot, arr + --j)) {}                                       \
+            if (i >= j) break;                                                              \
+            name##_swap(arr + i, arr + j);                                                  \
+        }                                                                                   \
+        name##_swap(arr, arr + j);                                                          \
+        return j;                                                                           \
+    }                                                                                       \
+                                                                                            \
+    /* Introsort: recurse on the smaller side, heap sort once depth_limit runs out. */      \
+    /* If has_pred is set, arr[-1] is a key not greater than any key of the range. */       \
+    static inline void name##_quick_sort_range(type *arr, size_t nitems,                    \
+                                               size_t depth_limit, int has_pred,            \
+                                               size_t cutoff) {                             \
+        while (nitems > 1) {                                                                \
+            if (nitems <= cutoff) {                                                         \
+                name##_insertion_sort(arr, nitems);                                         \
+                return;                                                                     \
+            }                                                                               \
+            if (depth_limit == 0) {                                                         \
+                name##_heap_sort(arr, nitems);                                              \
+                return;                                                                     \
+            }                                                                               \
+            depth_limit--;                                                                  \
+            name##_choose_pivot(arr, nitems);                                               \
+                                                                                            \
+            /* Many keys equal to the pivot: skip them all at once */                       \
+            if (has_pred && !name##_less(arr - 1, arr)) {                                   \
+                size_t last = name##_partition_equal(arr, nitems);                          \
+                arr += last + 1;                                                            \
+                nitems -= last + 1;                                                         \
+                continue;                                                                   \
+            }                                                                               \
+                                                                                            \
+            size_t p = name##_partition(arr, nitems);                                       \
+            if (p < nitems - 1 - p) {                                                       \
+                name##_quick_sort_range(arr, p, depth_limit, has_pred, cutoff);             \
+                arr += p + 1;                                                               \
+                nitems -= p + 1;                                                            \
+                has_pred = 1;                                                               \
+            } else {                                                                        \
+                name##_quick_sort_range(arr + p + 1, nitems - p - 1, depth_limit, 1,        \
+                                        cutoff);                                            \
+                nitems = p;                                                                 \
+            }                                                                               \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    static inline void name##_quick_sort(type *base, size_t nitems) {                       \
+        if (nitems < 2 || base == NULL) return;                                             \
+        size_t depth_limit = 0;                                                             \
+        for (size_t n = nitems; n > 1; n >>= 1) depth_limit += 2;                           \
+        name##_quick_sort_range(base, nitems, depth_limit, 0, sort_cutoff(sizeof(type)));   \
+    }                                                                                       \
+                                                                                            \
+    /* Floyd-Rivest: move the element of rank k to arr[k], arr[left..right] holding the */  \
+    /* ranks left to right. On long ranges k is first selected within a sample around */    \
+    /* its expected position, which leaves a pivot very close to the answer at arr[k]. */   \
+    static inline void name##_select_range(type *arr, size_t left, size_t right, size_t k,  \
+                                           size_t depth_limit) {                            \
+        while (right > left) {                                                              \
+            if (depth_limit == 0) {                                                         \
+                name##_heap_sort(arr + left, right - left + 1);                             \
+                return;                                                                     \
+            }                                                                               \
+            depth_limit--;                                                                  \
+            if (right - left > 600) {                                                       \
+                double n = (double)(right - left + 1);                                      \
+                double i = (double)(k - left + 1);                                          \
+                double z = log(n);                                                          \
+                double s = 0.5 * exp(2.0 * z / 3.0);                                        \
+                double sd = 0.5 * sqrt(z * s * (n - s) / n) * (i < n / 2 ? -1.0 : 1.0);     \
+                double low = (double)k - i * s / n + sd;                                    \
+                double high = (double)k + (n - i) * s / n + sd;                             \
+                name##_select_range(arr, low > (double)left ? (size_t)low : left,           \
+                                    high < (double)right ? (size_t)high : right, k,         \
+                                    depth_limit);                                           \
+            }                                                                               \
+                                                                                            \
+            /* Partition around t = arr[k], with arr[left] <= t <= arr[right] as guards */  \
+            type t = arr[k];                                                                \
+            size_t i = left, j = right;                                                     \
+            name##_swap(arr + left, arr + k);                                               \
+            if (name##_less(&t, arr + right)) name##_swap(arr + right, arr + left);         \
+            while (i < j) {                                                                 \
+                name##_swap(arr + i, arr + j);                                              \
+                i++;                                                                        \
+                j--;                                                                        \
+                while (name##_less(arr + i, &t)) i++;                                       \
+                while (name##_less(&t, arr + j)) j--;                                       \
+            }                                                                               \
+            if (!name##_less(arr + left, &t)) {                                             \
+                name##_swap(arr + left, arr + j);                                           \
+            } else {                                                                        \
+                j++;                                                                        \
+                name##_swap(arr + j, arr + right);                                          \
+            }                                                                               \
+                                                                                            \
+            /* t is now at arr[j], in its final position */                                 \
+            if (j == k) return;                                                             \
+            if (j < k)                                                                      \
+                left = j + 1;                                                               \
+            else                                                                            \
+                right = j - 1;                                                              \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    /* Select the sorted ranks[0..nranks), all within [left, right]: the middle one */      \
+    /* splits both the range and the ranks, the smaller ones are selected on its left */    \
+    static inline void name##_multi_select_range(type *arr, size_t left, size_t right,      \
+                                                 const size_t *ranks, size_t nranks,        \
+                                                 size_t depth_limit) {                      \
+        while (nranks > 0) {                                                                \
+            size_t mid = nranks / 2, k = ranks[mid];                                        \
+            name##_select_range(arr, left, right, k, depth_limit);                          \
+            size_t below = mid, above = mid + 1;                                            \
+            while (below > 0 && ranks[below - 1] == k) below--;                             \
+            while (above < nranks && ranks[above] == k) above++;                            \
+            if (below > 0)                                                                  \
+                name##_multi_select_range(arr, left, k - 1, ranks, below, depth_limit);     \
+            left = k + 1;                                                                   \
+            ranks += above;                                                                 \
+            nranks -= above;                                                                \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    static inline void name##_multi_select(type *base, size_t nitems, const size_t *ranks,  \
+                                           size_t nranks) {                                 \
+        if (nitems < 2 || base == NULL) return;                                             \
+        size_t depth_limit = 0;                                                             \
+        for (size_t n = nitems; n > 1; n >>= 1) depth_limit += 2;                           \
+        name##_multi_select_range(base, 0, nitems - 1, ranks, nranks, depth_limit);         \
+    }
+
+#endif // SORT_TEMPLATE_H
@@ -0,0 +1,71 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/**
+ * A fixed-size pool of worker threads for fork-join parallelism.
+ *
+ * Every thread owns a deque of tasks: tasks spawned by a thread are pushed on the
+ * bottom of its own deque and popped from there (most recent first), while idle
+ * threads steal from the top of the other deques (oldest, i.e. biggest, first).
+ * A thread that is not one of the workers, such as the one that created the pool,
+ * uses the first deque, so it can spawn tasks and help running them while it waits.
+ */
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * A set of spawned tasks that can be waited for together.
+ * Must be initialised with TASK_GROUP_INIT before its first use.
+ */
+typedef struct {
+    atomic_size_t pending;
+} TaskGroup;
+
+#define TASK_GROUP_INIT { 0 }
+
+/**
+ * Creates a pool of `nthreads` threads in total: `nthreads - 1` workers are started,
+ * the calling thread counts as the last one when it waits on a task group.
+ *
+ * @param nthreads The number of threads (values below 1 are treated as 1).
+ * @return A pointer to the new pool, or NULL if memory or threads cannot be obtained.
+ */
+ThreadPool *thread_pool_create(size_t nthreads);
+
+/**
+ * Stops the worker threads and frees the pool. No task may still be pending.
+ *
+ * @param pool A pointer to the pool (may be NULL).
+ */
+void thread_pool_free(ThreadPool *pool);
+
+/**
+ * Returns the number of threads of the pool, including the calling thread.
+ *
+ * @param pool A pointer to the pool.
+ */
+size_t thread_pool_size(const ThreadPool *pool);
+
+/**
+ * Schedules `func(arg)` to run on some thread of the pool as part of `group`.
+ * If the task cannot be queued it is run immediately on the calling thread.
+ *
+ * @param pool  A pointer to the pool.
+ * @param group The group the task belongs to.
+ * @param func  The function to run.
+ * @param arg   The argument passed to `func`; it must stay valid until the task has run.
+ */
+void thread_pool_spawn(ThreadPool *pool, TaskGroup *group, void (*func)(void *), void *arg);
+
+/**
+ * Waits until every task of `group` has completed. While waiting, the calling thread
+ * runs queued tasks itself, so nested spawn/wait calls cannot deadlock.
+ *
+ * @param pool  A pointer to the pool.
+ * @param group The group to wait for.
+ */
+void thread_pool_wait(ThreadPool *pool, TaskGroup *group);
+
+#endif // THREAD_POOL_H
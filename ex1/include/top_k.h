@@ -0,0 +1,24 @@
+#ifndef TOP_K_H
+#define TOP_K_H
+
+#include <stdio.h>
+#include "record.h"
+
+/* Function to write the first `options->limit` records of a file in sorted order,
+ * without loading the whole input.
+ *
+ * The input, CSV or a binary record file (see record_file.h), is streamed in small
+ * chunks through a max-heap of at most `limit` records, whose root is the record that
+ * the next smaller one replaces: O(n log K) time and O(K) memory for K = limit. Records
+ * are compared like compare_record() by `options->field`, and equal records keep their
+ * input order, so the output is the first K lines of what a stable sort (merge, tim or
+ * automatic) would write; `options->algo` is not used.
+ *
+ * @param infile  Pointer to the input file containing records.
+ * @param outfile Pointer to the output file where the records will be written.
+ * @param options The sort options; `limit` must be non-zero.
+ * @return 0 on success, -1 if memory cannot be allocated or the input cannot be used.
+ */
+int top_k_records(FILE *infile, FILE *outfile, const SortOptions *options);
+
+#endif
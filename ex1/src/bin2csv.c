@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "csv_writer.h"
+#include "record_file.h"
+
+// Convert a binary record file back to CSV
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <input.bin> <output.csv>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) {
+        fprintf(stderr, "Error: Unable to open input file '%s'\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    RecordFile binary;
+    int kind = record_file_map(&binary, in);
+    if (kind != 0) {
+        if (kind > 0) fprintf(stderr, "Error: '%s' is not a binary record file\n", argv[1]);
+        fclose(in);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        fprintf(stderr, "Error: Unable to open output file '%s'\n", argv[2]);
+        record_file_unmap(&binary);
+        fclose(in);
+        exit(EXIT_FAILURE);
+    }
+
+    CsvWriter writer;
+    csv_writer_open(&writer, out);
+    for (size_t i = 0; i < binary.count; i++) csv_writer_put(&writer, &binary.records[i]);
+    int failed = csv_writer_close(&writer) != 0;
+    if (fclose(out) != 0) failed = 1;
+    record_file_unmap(&binary);
+    fclose(in);
+
+    if (failed) {
+        fprintf(stderr, "Error: failed to write '%s'\n", argv[2]);
+        exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+}
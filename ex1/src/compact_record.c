@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <string.h>
+#include "compact_record.h"
+
+// Initial size of an arena filled one string at a time
+#define INITIAL_ARENA_SIZE 65536
+
+// Function to initialise an empty arena
+void string_arena_init(StringArena *strings) {
+    strings->data = NULL;
+    strings->used = 0;
+    strings->capacity = 0;
+}
+
+// Function to release the memory of an arena
+void string_arena_free(StringArena *strings) {
+    free(strings->data);
+    string_arena_init(strings);
+}
+
+// Function to convert a record to the compact layout
+int compact_record_set(CompactRecord *compact, const Record *record, StringArena *strings) {
+    size_t length = strnlen(record->field1, sizeof(record->field1) - 1);
+    if (strings->capacity - strings->used < length + 1) {
+        size_t capacity = strings->capacity ? strings->capacity * 2 : INITIAL_ARENA_SIZE;
+        char *grown = realloc(strings->data, capacity);
+        if (!grown) return -1;
+        strings->data = grown;
+        strings->capacity = capacity;
+    }
+
+    memcpy(strings->data + strings->used, record->field1, length);
+    strings->data[strings->used + length] = '\0';
+    compact->field1_offset = strings->used;
+    compact->field1_length = (uint32_t)length;
+    compact->id = record->id;
+    compact->field2 = record->field2;
+    compact->field3 = record->field3;
+    strings->used += length + 1;
+    return 0;
+}
+
+// Function to compare two compact records
+int compare_compact_r(const void *a, const void *b, void *order) {
+    const CompactRecord *ra = (const CompactRecord *)a;
+    const CompactRecord *rb = (const CompactRecord *)b;
+    const CompactOrder *by = (const CompactOrder *)order;
+
+    switch (by->field) {
+        case 1:
+            return strcmp(compact_field1(ra, by->strings), compact_field1(rb, by->strings));
+        case 2:
+            return (ra->field2 > rb->field2) - (ra->field2 < rb->field2);
+        case 3:
+            return (ra->field3 > rb->field3) - (ra->field3 < rb->field3);
+        default:
+            return 0;
+    }
+}
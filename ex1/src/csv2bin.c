@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "csv_reader.h"
+#include "record_file.h"
+
+// Records converted at a time
+#define CHUNK_RECORDS 65536
+
+// Convert a CSV file of records to a binary record file
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <input.csv> <output.bin>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *in = fopen(argv[1], "r");
+    if (!in) {
+        fprintf(stderr, "Error: Unable to open input file '%s'\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *out = fopen(argv[2], "wb");
+    if (!out) {
+        fprintf(stderr, "Error: Unable to open output file '%s'\n", argv[2]);
+        fclose(in);
+        exit(EXIT_FAILURE);
+    }
+
+    Record *chunk = malloc(sizeof(Record) * CHUNK_RECORDS);
+    if (!chunk) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // The count is only known at the end: write a placeholder header and fix it after
+    CsvReader reader;
+    int mapped = csv_reader_open(&reader, in) == 0;
+    int failed = record_file_write_header(out, 0) != 0;
+    size_t total = 0;
+    while (!failed) {
+        size_t count = mapped ? csv_reader_read(&reader, chunk, CHUNK_RECORDS)
+                              : read_records(in, chunk, CHUNK_RECORDS);
+        if (count == 0) break;
+        failed = record_file_append(out, chunk, count) != 0;
+        total += count;
+    }
+    if (mapped) csv_reader_close(&reader);
+
+    if (!failed) failed = fseek(out, 0, SEEK_SET) != 0 || record_file_write_header(out, total) != 0;
+    if (fclose(out) != 0) failed = 1;
+    fclose(in);
+    free(chunk);
+
+    if (failed) {
+        fprintf(stderr, "Error: failed to write '%s'\n", argv[2]);
+        exit(EXIT_FAILURE);
+    }
+    printf("Converted %zu records\n", total);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,436 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "csv_reader.h"
+#include "thread_pool.h"
+
+// Maximum number of malformed lines reported one by one
+#define MAX_REPORTED_LINES 10
+// Longest float token converted without a heap allocation
+#define FLOAT_TOKEN_SIZE 64
+// Minimum number of bytes parsed by each thread of csv_reader_read_all()
+#define PARSE_GRAIN (256 * 1024)
+
+// Powers of ten that are exactly representable as floats
+static const float powers_of_ten[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                      1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+// Whether c is a blank that fscanf would skip inside a line
+static int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Skip blanks starting at p
+static const char *skip_blanks(const char *p, const char *end) {
+    while (p < end && is_blank(*p)) p++;
+    return p;
+}
+
+// Parse an int like %d. Returns a pointer past the number, or NULL if there is none
+// or it does not fit in an int.
+static const char *parse_int(const char *p, const char *end, int *value) {
+    p = skip_blanks(p, end);
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    const char *digits = p;
+    long long result = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        result = result * 10 + (*p++ - '0');
+        if (result > 2147483648LL) return NULL;
+    }
+    if (p == digits) return NULL;
+
+    if (negative) result = -result;
+    if (result > 2147483647LL) return NULL;
+    *value = (int)result;
+    return p;
+}
+
+// Parse a float with strtof, which needs a NUL-terminated copy of the token.
+// Returns a pointer past the number, or NULL if there is none.
+static const char *parse_float_slow(const char *p, const char *end, float *value) {
+    size_t length = (size_t)(end - p);
+    char small[FLOAT_TOKEN_SIZE];
+    char *token = length < sizeof(small) ? small : malloc(length + 1);
+    if (!token) return NULL;
+    memcpy(token, p, length);
+    token[length] = '\0';
+
+    char *stop;
+    *value = strtof(token, &stop);
+    const char *result = stop == token ? NULL : p + (stop - token);
+    if (token != small) free(token);
+    return result;
+}
+
+// Parse a float like %f. Plain decimals whose digits form an integer m below 2^24, with
+// a decimal exponent k within +-10, are computed as m * 10^k or m / 10^-k: both operands
+// are exact floats, so the single rounding of the operation is the correct one.
+// Everything else goes through strtof. Returns a pointer past the number, or NULL if there is none.
+static const char *parse_float(const char *p, const char *end, float *value) {
+    const char *start = skip_blanks(p, end);
+    p = start;
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    uint32_t mantissa = 0;
+    int significant = 0, scale = 0, any_digit = 0, exact = 1;
+    while (p < end && *p >= '0' && *p <= '9') {
+        any_digit = 1;
+        if (mantissa != 0 || *p != '0') {
+            if (++significant > 8) exact = 0;
+            mantissa = mantissa * 10 + (uint32_t)(*p - '0');
+        }
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            any_digit = 1;
+            if (mantissa != 0 || *p != '0') {
+                if (++significant > 8) exact = 0;
+                mantissa = mantissa * 10 + (uint32_t)(*p - '0');
+            }
+            scale--;
+            p++;
+        }
+    }
+    if (!any_digit) return parse_float_slow(start, end, value);
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        int exp_negative = 0, exponent = 0;
+        if (q < end && (*q == '-' || *q == '+')) exp_negative = *q++ == '-';
+        if (q == end || *q < '0' || *q > '9') return parse_float_slow(start, end, value);
+        while (q < end && *q >= '0' && *q <= '9') {
+            if (exponent < 10000) exponent = exponent * 10 + (*q - '0');
+            q++;
+        }
+        scale += exp_negative ? -exponent : exponent;
+        p = q;
+    }
+
+    if (!exact || mantissa >= (1u << 24) || scale < -10 || scale > 10) {
+        return parse_float_slow(start, end, value);
+    }
+
+    float result = (float)mantissa;
+    if (scale < 0)
+        result /= powers_of_ten[-scale];
+    else
+        result *= powers_of_ten[scale];
+    *value = negative ? -result : result;
+    return p;
+}
+
+// Parse the fields of a line, leaving field1 where it is in the line: its start and
+// length are returned in *field1 and *length. Returns 0 on success, -1 if malformed.
+static int parse_line_fields(const char *line, const char *end, int *id, const char **field1,
+                             size_t *length, int *field2, float *field3) {
+    const char *p = parse_int(line, end, id);
+    if (!p || p == end || *p != ',') return -1;
+    p++;
+
+    const char *comma = memchr(p, ',', (size_t)(end - p));
+    *length = comma ? (size_t)(comma - p) : 0;
+    if (*length == 0 || *length >= sizeof(((Record *)NULL)->field1)) return -1;
+    *field1 = p;
+    p = comma + 1;
+
+    p = parse_int(p, end, field2);
+    if (!p || p == end || *p != ',') return -1;
+    p++;
+
+    p = parse_float(p, end, field3);
+    if (!p || skip_blanks(p, end) != end) return -1;
+    return 0;
+}
+
+// Function to parse one CSV line into a record
+int parse_record_line(const char *line, const char *end, Record *record) {
+    const char *field1;
+    size_t length;
+    if (parse_line_fields(line, end, &record->id, &field1, &length, &record->field2,
+                          &record->field3) != 0) {
+        return -1;
+    }
+    memcpy(record->field1, field1, length);
+    record->field1[length] = '\0';
+    return 0;
+}
+
+// Parse one CSV line into a compact record, copying field1 and its NUL to `strings`.
+// The offset of field1 is left to the caller. Returns 0 on success, -1 if malformed.
+static int parse_compact_line(const char *line, const char *end, CompactRecord *record,
+                              char *strings) {
+    const char *field1;
+    size_t length;
+    if (parse_line_fields(line, end, &record->id, &field1, &length, &record->field2,
+                          &record->field3) != 0) {
+        return -1;
+    }
+    memcpy(strings, field1, length);
+    strings[length] = '\0';
+    record->field1_length = (uint32_t)length;
+    return 0;
+}
+
+// Function to map a file for reading
+int csv_reader_open(CsvReader *reader, FILE *file) {
+    struct stat info;
+    long offset = ftell(file);
+    if (offset < 0 || fstat(fileno(file), &info) != 0 || !S_ISREG(info.st_mode)) return -1;
+
+    reader->data = NULL;
+    reader->length = 0;
+    reader->pos = 0;
+    reader->line = 1;
+    reader->malformed = 0;
+    reader->file = file;
+
+    if ((size_t)offset >= (size_t)info.st_size) return 0;
+
+    void *mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (mapping == MAP_FAILED) return -1;
+    madvise(mapping, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+    reader->data = (const char *)mapping;
+    reader->length = (size_t)info.st_size;
+    reader->pos = (size_t)offset;
+    return 0;
+}
+
+// Number of lines in [p, end), counting a last line without a newline
+static size_t count_lines(const char *p, const char *end) {
+    size_t lines = 0;
+    while (p < end) {
+        const char *newline = memchr(p, '\n', (size_t)(end - p));
+        lines++;
+        if (!newline) break;
+        p = newline + 1;
+    }
+    return lines;
+}
+
+// Function to count the lines left to read
+size_t csv_reader_count_lines(const CsvReader *reader) {
+    return count_lines(reader->data + reader->pos, reader->data + reader->length);
+}
+
+// Function to parse the next records
+size_t csv_reader_read(CsvReader *reader, Record *records, size_t capacity) {
+    size_t count = 0;
+    while (count < capacity && reader->pos < reader->length) {
+        const char *line = reader->data + reader->pos;
+        const char *newline = memchr(line, '\n', reader->length - reader->pos);
+        const char *end = newline ? newline : reader->data + reader->length;
+        reader->pos = (size_t)(end - reader->data) + (newline ? 1 : 0);
+        size_t number = reader->line++;
+
+        // Blank lines are skipped silently, as fscanf would
+        if (skip_blanks(line, end) == end) continue;
+
+        if (parse_record_line(line, end, &records[count]) == 0) {
+            count++;
+        } else if (++reader->malformed <= MAX_REPORTED_LINES) {
+            fprintf(stderr, "Warning: skipping malformed line %zu\n", number);
+        }
+    }
+    return count;
+}
+
+// Function to unmap the file
+void csv_reader_close(CsvReader *reader) {
+    if (reader->data) munmap((void *)reader->data, reader->length);
+    fseek(reader->file, 0, SEEK_END);
+    if (reader->malformed > 0) {
+        fprintf(stderr, "Warning: %zu malformed lines skipped\n", reader->malformed);
+    }
+}
+
+// The lines of one byte range of the mapping, parsed by one task of read_all()
+typedef struct {
+    const char *begin;
+    const char *end;
+    size_t lines;         // Lines in the range, which bound the records it holds
+    void *records;        // Where the records of the range are written
+    char *strings;        // Where field1 of compact records is written (NULL for Records)
+    uint64_t strings_offset; // Offset of `strings` in the arena
+    size_t strings_used;  // Bytes written to `strings`
+    size_t count;         // Records parsed
+    size_t first_line;    // Number of the first line of the range
+    size_t malformed;     // Malformed lines skipped
+    size_t reported[MAX_REPORTED_LINES]; // Numbers of the first malformed lines
+} ParseRange;
+
+// Task body: count the lines of a range
+static void count_range_task(void *arg) {
+    ParseRange *range = (ParseRange *)arg;
+    range->lines = count_lines(range->begin, range->end);
+}
+
+// Task body: parse the lines of a range into its part of the record array
+static void parse_range_task(void *arg) {
+    ParseRange *range = (ParseRange *)arg;
+    const char *p = range->begin;
+    size_t number = range->first_line;
+    while (p < range->end) {
+        const char *newline = memchr(p, '\n', (size_t)(range->end - p));
+        const char *end = newline ? newline : range->end;
+
+        if (skip_blanks(p, end) != end) {
+            int result;
+            if (range->strings) {
+                CompactRecord *record = (CompactRecord *)range->records + range->count;
+                result = parse_compact_line(p, end, record, range->strings + range->strings_used);
+                if (result == 0) {
+                    record->field1_offset = range->strings_offset + range->strings_used;
+                    range->strings_used += record->field1_length + 1;
+                }
+            } else {
+                result = parse_record_line(p, end, (Record *)range->records + range->count);
+            }
+
+            if (result == 0) {
+                range->count++;
+            } else if (range->malformed++ < MAX_REPORTED_LINES) {
+                range->reported[range->malformed - 1] = number;
+            }
+        }
+        number++;
+        p = end + 1;
+    }
+}
+
+// Run func on every range, spread over the pool (if any), and wait for all of them
+static void run_range_tasks(ThreadPool *pool, ParseRange *ranges, size_t nranges,
+                            void (*func)(void *)) {
+    if (!pool) {
+        for (size_t i = 0; i < nranges; i++) func(&ranges[i]);
+        return;
+    }
+    TaskGroup group = TASK_GROUP_INIT;
+    for (size_t i = 0; i + 1 < nranges; i++) thread_pool_spawn(pool, &group, func, &ranges[i]);
+    func(&ranges[nranges - 1]);
+    thread_pool_wait(pool, &group);
+}
+
+// Parse all the remaining records, as Records, or as CompactRecords if strings is not
+// NULL. In that case the arena is allocated in one go with room for the whole input,
+// which is more than field1 of all its lines needs, so each range can be given its own
+// slot of the arena as well.
+static void *read_all(CsvReader *reader, size_t nthreads, size_t *count, StringArena *strings) {
+    size_t size = strings ? sizeof(CompactRecord) : sizeof(Record);
+    if (strings) string_arena_init(strings);
+    size_t remaining = reader->length - reader->pos;
+    size_t nranges = remaining / PARSE_GRAIN;
+    if (nranges > nthreads) nranges = nthreads;
+
+    // Small input, a single thread or no threads: parse sequentially as a single range
+    ThreadPool *pool = nranges > 1 ? thread_pool_create(nranges) : NULL;
+    if (!pool) nranges = 1;
+    ParseRange *ranges = calloc(nranges, sizeof(ParseRange));
+    if (!ranges) {
+        thread_pool_free(pool);
+        *count = 0;
+        return NULL;
+    }
+
+    // Split the input into ranges of about the same size that end just after a newline
+    const char *data = reader->data;
+    const char *end = data + reader->length;
+    const char *begin = data + reader->pos;
+    for (size_t i = 0; i < nranges; i++) {
+        const char *target = data + reader->pos + remaining * (i + 1) / nranges;
+        if (target < begin) target = begin;
+        const char *newline = i + 1 < nranges && target < end ?
+                              memchr(target, '\n', (size_t)(end - target)) : NULL;
+        ranges[i].begin = begin;
+        ranges[i].end = newline ? newline + 1 : end;
+        begin = ranges[i].end;
+    }
+
+    // Size the array from the line counts, giving each range a contiguous slot
+    run_range_tasks(pool, ranges, nranges, count_range_task);
+    size_t lines = 0;
+    for (size_t i = 0; i < nranges; i++) lines += ranges[i].lines;
+    char *records = malloc(size * (lines > 0 ? lines : 1));
+    if (strings) {
+        strings->data = records ? malloc(remaining + 1) : NULL;
+        strings->capacity = remaining + 1;
+        if (!strings->data) {
+            free(records);
+            records = NULL;
+            string_arena_init(strings);
+        }
+    }
+
+    if (records) {
+        size_t offset = 0, number = reader->line;
+        for (size_t i = 0; i < nranges; i++) {
+            ranges[i].records = records + offset * size;
+            ranges[i].first_line = number;
+            if (strings) {
+                ranges[i].strings_offset = (uint64_t)(ranges[i].begin - (data + reader->pos));
+                ranges[i].strings = strings->data + ranges[i].strings_offset;
+            }
+            offset += ranges[i].lines;
+            number += ranges[i].lines;
+        }
+        run_range_tasks(pool, ranges, nranges, parse_range_task);
+
+        // Close the gaps left by blank and malformed lines (and in the arena by the
+        // other fields), keeping the file order, and report the malformed lines in order
+        *count = 0;
+        for (size_t i = 0; i < nranges; i++) {
+            memmove(records + *count * size, ranges[i].records, size * ranges[i].count);
+            if (strings) {
+                CompactRecord *moved = (CompactRecord *)records + *count;
+                uint64_t shift = ranges[i].strings_offset - strings->used;
+                for (size_t k = 0; k < ranges[i].count; k++) moved[k].field1_offset -= shift;
+                memmove(strings->data + strings->used, ranges[i].strings, ranges[i].strings_used);
+                strings->used += ranges[i].strings_used;
+            }
+            *count += ranges[i].count;
+            for (size_t k = 0; k < ranges[i].malformed && k < MAX_REPORTED_LINES; k++) {
+                if (++reader->malformed <= MAX_REPORTED_LINES) {
+                    fprintf(stderr, "Warning: skipping malformed line %zu\n", ranges[i].reported[k]);
+                }
+            }
+            if (ranges[i].malformed > MAX_REPORTED_LINES) {
+                reader->malformed += ranges[i].malformed - MAX_REPORTED_LINES;
+            }
+        }
+        reader->pos = reader->length;
+        reader->line = number;
+
+        // Give back the part of the arena taken by the other fields
+        if (strings && strings->used < strings->capacity) {
+            char *shrunk = realloc(strings->data, strings->used > 0 ? strings->used : 1);
+            if (shrunk) {
+                strings->data = shrunk;
+                strings->capacity = strings->used > 0 ? strings->used : 1;
+            }
+        }
+    } else {
+        *count = 0;
+    }
+
+    thread_pool_free(pool);
+    free(ranges);
+    return records;
+}
+
+// Function to parse all the remaining records, with several threads for big inputs
+Record *csv_reader_read_all(CsvReader *reader, size_t nthreads, size_t *count) {
+    return read_all(reader, nthreads, count, NULL);
+}
+
+// Function to parse all the remaining records in the compact layout
+CompactRecord *csv_reader_read_all_compact(CsvReader *reader, size_t nthreads, size_t *count,
+                                           StringArena *strings) {
+    return read_all(reader, nthreads, count, strings);
+}
@@ -0,0 +1,158 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "csv_writer.h"
+
+// Size of the output buffer
+#define WRITE_BUFFER_SIZE (1 << 20)
+// Largest float magnitude times 10^6 that is converted without snprintf (2^53)
+#define EXACT_FLOAT_LIMIT 9007199254740992.0
+
+// "00" .. "99", to produce two digits per division
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Write the decimal digits of value at p. Returns a pointer past the last digit.
+static char *format_uint(char *p, uint64_t value) {
+    char digits[20];
+    char *q = digits + sizeof(digits);
+    while (value >= 100) {
+        q -= 2;
+        memcpy(q, digit_pairs + (value % 100) * 2, 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        q -= 2;
+        memcpy(q, digit_pairs + value * 2, 2);
+    } else {
+        *--q = (char)('0' + value);
+    }
+    size_t length = (size_t)(digits + sizeof(digits) - q);
+    memcpy(p, q, length);
+    return p + length;
+}
+
+// Write an int like %d
+static char *format_int(char *p, int value) {
+    uint64_t magnitude = (uint64_t)(value < 0 ? -(int64_t)value : value);
+    if (value < 0) *p++ = '-';
+    return format_uint(p, magnitude);
+}
+
+// Write a float like %f, with end the end of the buffer for the snprintf fallback
+static char *format_float(char *p, char *end, float value) {
+    double x = value;
+    int negative = x < 0 || (x == 0 && 1 / x < 0);
+    double scaled = (negative ? -x : x) * 1e6;
+    if (!(scaled < EXACT_FLOAT_LIMIT)) {
+        return p + snprintf(p, (size_t)(end - p), "%f", x);
+    }
+
+    // Round half to even, as printf does in the default rounding mode
+    uint64_t units = (uint64_t)scaled;
+    double fraction = scaled - (double)units;
+    if (fraction > 0.5 || (fraction == 0.5 && (units & 1))) units++;
+
+    if (negative) *p++ = '-';
+    p = format_uint(p, units / 1000000);
+    *p++ = '.';
+    uint32_t decimals = (uint32_t)(units % 1000000);
+    memcpy(p, digit_pairs + (decimals / 10000) * 2, 2);
+    memcpy(p + 2, digit_pairs + (decimals / 100 % 100) * 2, 2);
+    memcpy(p + 4, digit_pairs + (decimals % 100) * 2, 2);
+    return p + 6;
+}
+
+// Format the fields of a record, field1 being given with its length
+static size_t format_fields(char *line, int id, const char *field1, size_t length, int field2,
+                            float field3) {
+    char *p = format_int(line, id);
+    *p++ = ',';
+    memcpy(p, field1, length);
+    p += length;
+    *p++ = ',';
+    p = format_int(p, field2);
+    *p++ = ',';
+    p = format_float(p, line + RECORD_LINE_MAX - 1, field3);
+    *p++ = '\n';
+    return (size_t)(p - line);
+}
+
+// Function to format a record as a CSV line
+size_t format_record(char *line, const Record *record) {
+    size_t length = strnlen(record->field1, sizeof(record->field1) - 1);
+    return format_fields(line, record->id, record->field1, length, record->field2,
+                         record->field3);
+}
+
+// Function to format a compact record as a CSV line
+size_t format_compact_record(char *line, const CompactRecord *record, const StringArena *strings) {
+    return format_fields(line, record->id, compact_field1(record, strings), record->field1_length,
+                         record->field2, record->field3);
+}
+
+// Write the buffered bytes to the file descriptor, retrying short writes
+static void writer_flush(CsvWriter *writer) {
+    size_t done = 0;
+    while (done < writer->used && !writer->error) {
+        ssize_t written = write(writer->fd, writer->buffer + done, writer->used - done);
+        if (written > 0) {
+            done += (size_t)written;
+        } else if (written == 0 || errno != EINTR) {
+            // A write that makes no progress would otherwise be retried forever
+            writer->error = 1;
+        }
+    }
+    writer->used = 0;
+}
+
+// Function to start writing records to a file
+void csv_writer_open(CsvWriter *writer, FILE *file) {
+    fflush(file);
+    writer->file = file;
+    writer->fd = fileno(file);
+    writer->buffer = malloc(WRITE_BUFFER_SIZE);
+    writer->used = 0;
+    writer->capacity = WRITE_BUFFER_SIZE;
+    writer->error = 0;
+}
+
+// Function to append a record to the output
+void csv_writer_put(CsvWriter *writer, const Record *record) {
+    if (!writer->buffer) {
+        write_record(writer->file, record);
+        return;
+    }
+    if (writer->capacity - writer->used < RECORD_LINE_MAX) writer_flush(writer);
+    writer->used += format_record(writer->buffer + writer->used, record);
+}
+
+// Function to append a compact record to the output
+void csv_writer_put_compact(CsvWriter *writer, const CompactRecord *record,
+                            const StringArena *strings) {
+    if (!writer->buffer) {
+        char line[RECORD_LINE_MAX];
+        fwrite(line, 1, format_compact_record(line, record, strings), writer->file);
+        return;
+    }
+    if (writer->capacity - writer->used < RECORD_LINE_MAX) writer_flush(writer);
+    writer->used += format_compact_record(writer->buffer + writer->used, record, strings);
+}
+
+// Function to write out the buffered lines
+int csv_writer_close(CsvWriter *writer) {
+    if (!writer->buffer) return ferror(writer->file) ? -1 : 0;
+
+    writer_flush(writer);
+    free(writer->buffer);
+    writer->buffer = NULL;
+
+    // Bring the stdio position of the file up to date with the descriptor
+    off_t position = lseek(writer->fd, 0, SEEK_CUR);
+    if (position >= 0) fseeko(writer->file, position, SEEK_SET);
+    return writer->error ? -1 : 0;
+}
@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "csv_writer.h"
+#include "external_sort.h"
+#include "record_stream.h"
+
+// Smallest chunk sorted in memory, whatever the budget
+#define MIN_CHUNK_RECORDS 1024
+// Smallest read or write buffer of a run, in records
+#define MIN_RUN_BUFFER 256
+// Maximum number of runs merged at once
+#define MAX_FAN_IN 128
+// Loser tree entry that beats every run, used while the tree is being built
+#define SENTINEL_MIN ((size_t)-1)
+
+// Run files produced so far, in input order
+typedef struct {
+    FILE **files;
+    size_t count;
+    size_t capacity;
+} RunList;
+
+// Buffered reader over one run file
+typedef struct {
+    FILE *file;
+    Record *buffer;
+    size_t capacity;
+    size_t count;
+    size_t pos;
+    int error;
+} RunReader;
+
+// Destination of a merge: a binary run file or the CSV output
+typedef struct {
+    FILE *file;
+    CsvWriter *csv;      // The CSV output, or NULL for a binary run file
+    Record *buffer;
+    size_t capacity;
+    size_t count;
+    int error;
+} RunWriter;
+
+// Create an anonymous run file in the temporary directory. The file is unlinked
+// right away, so it disappears as soon as it is closed.
+static FILE *create_run_file(const char *tmp_dir) {
+    const char *dir = tmp_dir ? tmp_dir : getenv("TMPDIR");
+    if (!dir || !*dir) dir = "/tmp";
+
+    size_t length = strlen(dir) + sizeof("/ex1_runXXXXXX");
+    char *path = malloc(length);
+    if (!path) return NULL;
+    snprintf(path, length, "%s/ex1_runXXXXXX", dir);
+
+    int fd = mkstemp(path);
+    if (fd >= 0) unlink(path);
+    free(path);
+    if (fd < 0) return NULL;
+
+    FILE *file = fdopen(fd, "w+b");
+    if (!file) close(fd);
+    return file;
+}
+
+// Append a run file to the list. Returns 0 on success, -1 if memory runs out.
+static int push_run(RunList *runs, FILE *file) {
+    if (runs->count == runs->capacity) {
+        size_t capacity = runs->capacity ? runs->capacity * 2 : 16;
+        FILE **grown = realloc(runs->files, sizeof(FILE *) * capacity);
+        if (!grown) return -1;
+        runs->files = grown;
+        runs->capacity = capacity;
+    }
+    runs->files[runs->count++] = file;
+    return 0;
+}
+
+// Close the run files from index first onwards
+static void close_runs(RunList *runs, size_t first) {
+    for (size_t i = first; i < runs->count; i++) fclose(runs->files[i]);
+    runs->count = first;
+}
+
+// Read the next block of a run. Returns 0 when the run is exhausted.
+static int reader_fill(RunReader *reader) {
+    reader->count = fread(reader->buffer, sizeof(Record), reader->capacity, reader->file);
+    reader->pos = 0;
+    if (reader->count == 0 && ferror(reader->file)) reader->error = 1;
+    return reader->count > 0;
+}
+
+// Whether the run has no records left
+static int reader_exhausted(const RunReader *reader) {
+    return reader->pos == reader->count;
+}
+
+// Move to the next record of a run, refilling the buffer when needed
+static void reader_advance(RunReader *reader) {
+    if (++reader->pos == reader->count) reader_fill(reader);
+}
+
+// Write any buffered binary records to the run file
+static void writer_flush(RunWriter *writer) {
+    if (!writer->csv && writer->count > 0 &&
+        fwrite(writer->buffer, sizeof(Record), writer->count, writer->file) != writer->count) {
+        writer->error = 1;
+    }
+    writer->count = 0;
+}
+
+// Send one record to the destination of the merge
+static void writer_put(RunWriter *writer, const Record *record) {
+    if (writer->csv) {
+        csv_writer_put(writer->csv, record);
+        return;
+    }
+    writer->buffer[writer->count++] = *record;
+    if (writer->count == writer->capacity) writer_flush(writer);
+}
+
+// Whether run a comes before run b in the loser tree: exhausted runs lose, and ties
+// go to the earlier run so that the merge is stable
+static int run_beats(const RunReader *readers, size_t a, size_t b, RecordCompar compar) {
+    if (a == SENTINEL_MIN) return 1;
+    if (b == SENTINEL_MIN) return 0;
+
+    int exhausted_a = reader_exhausted(&readers[a]);
+    int exhausted_b = reader_exhausted(&readers[b]);
+    if (exhausted_a || exhausted_b) return exhausted_b && (!exhausted_a || a < b);
+
+    int cmp = compar(&readers[a].buffer[readers[a].pos], &readers[b].buffer[readers[b].pos]);
+    return cmp < 0 || (cmp == 0 && a < b);
+}
+
+// Replay the matches from leaf s up to the root: each node keeps the loser and the
+// winner goes on; tree[0] receives the overall winner
+static void loser_tree_adjust(size_t *tree, size_t k, const RunReader *readers, size_t s,
+                              RecordCompar compar) {
+    for (size_t t = (s + k) / 2; t > 0; t /= 2) {
+        if (run_beats(readers, tree[t], s, compar)) {
+            size_t loser = s;
+            s = tree[t];
+            tree[t] = loser;
+        }
+    }
+    tree[0] = s;
+}
+
+// Merge k run files sorted by compar into the writer, with budget bytes for the read
+// buffers. Returns 0 on success, -1 on failure.
+static int merge_runs(FILE **files, size_t k, RunWriter *writer, size_t budget,
+                      RecordCompar compar) {
+    size_t buffer_records = budget / ((k + 1) * sizeof(Record));
+    if (buffer_records < MIN_RUN_BUFFER) buffer_records = MIN_RUN_BUFFER;
+
+    RunReader *readers = calloc(k, sizeof(RunReader));
+    size_t *tree = malloc(sizeof(size_t) * k);
+    int result = readers && tree ? 0 : -1;
+
+    for (size_t i = 0; result == 0 && i < k; i++) {
+        readers[i].file = files[i];
+        readers[i].capacity = buffer_records;
+        readers[i].buffer = malloc(sizeof(Record) * buffer_records);
+        if (!readers[i].buffer || fseek(files[i], 0, SEEK_SET) != 0) {
+            result = -1;
+        } else {
+            reader_fill(&readers[i]);
+        }
+    }
+
+    if (result == 0) {
+        // Build the tree: every node starts with the sentinel, which the leaves push out
+        for (size_t i = 0; i < k; i++) tree[i] = SENTINEL_MIN;
+        for (size_t i = k; i > 0; i--) loser_tree_adjust(tree, k, readers, i - 1, compar);
+
+        while (!reader_exhausted(&readers[tree[0]])) {
+            RunReader *winner = &readers[tree[0]];
+            writer_put(writer, &winner->buffer[winner->pos]);
+            reader_advance(winner);
+            loser_tree_adjust(tree, k, readers, tree[0], compar);
+        }
+        writer_flush(writer);
+
+        for (size_t i = 0; i < k; i++) {
+            if (readers[i].error) result = -1;
+        }
+        if (writer->error) result = -1;
+    }
+
+    for (size_t i = 0; readers && i < k; i++) free(readers[i].buffer);
+    free(readers);
+    free(tree);
+    return result;
+}
+
+// Sort each memory-sized chunk of the input and spill it as a run. If the whole input
+// fits in the first chunk it is written to the output directly and *done is set.
+static int create_runs(FILE *infile, CsvWriter *output, const SortOptions *options,
+                       RunList *runs, int *done) {
+    // Merge sort needs as much scratch space as the chunk itself
+    size_t chunk_records = options->max_memory / (2 * sizeof(Record));
+    if (chunk_records < MIN_CHUNK_RECORDS) chunk_records = MIN_CHUNK_RECORDS;
+
+    Record *chunk = malloc(sizeof(Record) * chunk_records);
+    if (!chunk) return -1;
+
+    RecordStream stream;
+    if (record_stream_open(&stream, infile) != 0) {
+        free(chunk);
+        return -1;
+    }
+
+    int result = 0;
+    *done = 0;
+    for (;;) {
+        size_t count = record_stream_read(&stream, chunk, chunk_records);
+        if (count == 0) break;
+        sort_record_array(chunk, count, options);
+
+        if (runs->count == 0 && count < chunk_records) {
+            for (size_t i = 0; i < count; i++) csv_writer_put(output, &chunk[i]);
+            *done = 1;
+            break;
+        }
+
+        FILE *run = create_run_file(options->tmp_dir);
+        if (!run || push_run(runs, run) != 0) {
+            if (run) fclose(run);
+            result = -1;
+            break;
+        }
+        if (fwrite(chunk, sizeof(Record), count, run) != count) {
+            result = -1;
+            break;
+        }
+        if (count < chunk_records) break;
+    }
+
+    record_stream_close(&stream);
+    free(chunk);
+    return result;
+}
+
+// Function to sort a CSV file of records using a bounded amount of memory
+int external_sort_records(FILE *infile, FILE *outfile, const SortOptions *options) {
+    RunList runs = {NULL, 0, 0};
+    CsvWriter output;
+    csv_writer_open(&output, outfile);
+    int done;
+    int result = create_runs(infile, &output, options, &runs, &done);
+    RecordCompar compar = record_comparator(options->field);
+
+    // Too many runs for one merge: merge groups of them into longer runs first
+    while (result == 0 && !done && runs.count > MAX_FAN_IN) {
+        RunList merged = {NULL, 0, 0};
+        for (size_t first = 0; result == 0 && first < runs.count; first += MAX_FAN_IN) {
+            size_t k = runs.count - first < MAX_FAN_IN ? runs.count - first : MAX_FAN_IN;
+
+            FILE *file = create_run_file(options->tmp_dir);
+            if (!file || push_run(&merged, file) != 0) {
+                if (file) fclose(file);
+                result = -1;
+                break;
+            }
+
+            // Half of the budget for the output buffer, half for the inputs
+            size_t budget = options->max_memory / 2;
+            size_t capacity = budget / sizeof(Record);
+            if (capacity < MIN_RUN_BUFFER) capacity = MIN_RUN_BUFFER;
+            RunWriter writer = {file, NULL, malloc(sizeof(Record) * capacity), capacity, 0, 0};
+            result = writer.buffer ? merge_runs(runs.files + first, k, &writer, budget, compar)
+                                   : -1;
+            free(writer.buffer);
+        }
+        close_runs(&runs, 0);
+        free(runs.files);
+        runs = merged;
+    }
+
+    // Final merge straight into the CSV output
+    if (result == 0 && !done && runs.count > 0) {
+        RunWriter writer = {outfile, &output, NULL, 0, 0, 0};
+        result = merge_runs(runs.files, runs.count, &writer, options->max_memory,
+                            compar);
+    }
+
+    close_runs(&runs, 0);
+    free(runs.files);
+    if (csv_writer_close(&output) != 0) result = -1;
+    return result;
+}
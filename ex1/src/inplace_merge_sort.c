@@ -0,0 +1,176 @@
+#include <string.h>
+#include "sort.h"
+#include "sort_cutoff.h"
+#include "sort_elem.h"
+
+// State shared by the merges of one sort
+typedef struct {
+    char *arr;              // The array being sorted
+    size_t size;            // Size in bytes of each element
+    const SortCompar *cmp;  // Comparison function
+    char *buffer;           // Scratch space for capacity elements
+    size_t capacity;        // About sqrt(n), or less (even 0) if memory is short
+} InPlaceMerge;
+
+// Address of element i
+static inline char *at(const InPlaceMerge *m, size_t i) {
+    return m->arr + i * m->size;
+}
+
+// Reverse the elements in [lo, hi)
+static void reverse(const InPlaceMerge *m, size_t lo, size_t hi) {
+    while (hi - lo > 1) {
+        elem_swap(at(m, lo), at(m, hi - 1), m->size);
+        lo++;
+        hi--;
+    }
+}
+
+// Exchange the blocks [lo, mid) and [mid, hi), through the buffer if the shorter one
+// fits in it, otherwise by three reversals
+static void rotate(const InPlaceMerge *m, size_t lo, size_t mid, size_t hi) {
+    size_t left = mid - lo, right = hi - mid, size = m->size;
+    if (left <= m->capacity && left <= right) {
+        memcpy(m->buffer, at(m, lo), size * left);
+        memmove(at(m, lo), at(m, mid), size * right);
+        memcpy(at(m, lo + right), m->buffer, size * left);
+    } else if (right <= m->capacity) {
+        memcpy(m->buffer, at(m, mid), size * right);
+        memmove(at(m, lo + right), at(m, lo), size * left);
+        memcpy(at(m, lo), m->buffer, size * right);
+    } else {
+        reverse(m, lo, mid);
+        reverse(m, mid, hi);
+        reverse(m, lo, hi);
+    }
+}
+
+// Merge [lo, mid) and [mid, hi) with the left run, which fits, copied to the buffer,
+// front to back: the output never overtakes the unread part of the right run
+static void merge_from_left(const InPlaceMerge *m, size_t lo, size_t mid, size_t hi) {
+    size_t size = m->size, count = mid - lo;
+    memcpy(m->buffer, at(m, lo), size * count);
+
+    size_t i = 0, j = mid, k = lo;
+    while (i < count && j < hi) {
+        // On ties the left element goes first, which keeps the merge stable
+        if (sort_compare(m->cmp, at(m, j), m->buffer + i * size) < 0)
+            elem_copy(at(m, k++), at(m, j++), size);
+        else
+            elem_copy(at(m, k++), m->buffer + i++ * size, size);
+    }
+    memcpy(at(m, k), m->buffer + i * size, size * (count - i));
+}
+
+// Merge [lo, mid) and [mid, hi) with the right run, which fits, copied to the buffer,
+// back to front
+static void merge_from_right(const InPlaceMerge *m, size_t lo, size_t mid, size_t hi) {
+    size_t size = m->size, count = hi - mid;
+    memcpy(m->buffer, at(m, mid), size * count);
+
+    size_t i = mid, j = count, k = hi;
+    while (i > lo && j > 0) {
+        // On ties the right element goes last, which keeps the merge stable
+        if (sort_compare(m->cmp, m->buffer + (j - 1) * size, at(m, i - 1)) < 0)
+            elem_copy(at(m, --k), at(m, --i), size);
+        else
+            elem_copy(at(m, --k), m->buffer + --j * size, size);
+    }
+    memcpy(at(m, lo), m->buffer, size * j);
+}
+
+// Stable merge of the sorted runs [lo, mid) and [mid, hi). Once a run fits in the
+// buffer they are merged through it; before that, SymMerge (Kim and Kutzner) splits
+// the problem: a binary search finds how much of the end of the left run and of the
+// start of the right run must change places around the middle of [lo, hi), those two
+// blocks are rotated, and the two halves are merged recursively.
+static void merge(const InPlaceMerge *m, size_t lo, size_t mid, size_t hi) {
+    if (lo == mid || mid == hi) return;
+    // If the two runs are already in order there is nothing to do
+    if (sort_compare(m->cmp, at(m, mid - 1), at(m, mid)) <= 0) return;
+
+    // Through the buffer, with the shorter run if both fit
+    size_t left = mid - lo, right = hi - mid;
+    if (left <= m->capacity && (left <= right || right > m->capacity)) {
+        merge_from_left(m, lo, mid, hi);
+        return;
+    }
+    if (right <= m->capacity) {
+        merge_from_right(m, lo, mid, hi);
+        return;
+    }
+
+    size_t half = lo + (hi - lo) / 2;
+    size_t n = half + mid;
+    size_t start, end;
+    if (mid > half) {
+        start = n - hi;
+        end = half;
+    } else {
+        start = lo;
+        end = mid;
+    }
+    size_t p = n - 1;
+    while (start < end) {
+        size_t c = start + (end - start) / 2;
+        if (sort_compare(m->cmp, at(m, p - c), at(m, c)) >= 0)
+            start = c + 1;
+        else
+            end = c;
+    }
+    end = n - start;
+
+    if (start < mid && mid < end) rotate(m, start, mid, end);
+    merge(m, lo, start, half);
+    merge(m, half, end, hi);
+}
+
+// Function to sort base[0 .. nitems) with at least two items, never failing
+void inplace_merge_sort_with(void *base, size_t nitems, size_t size, const SortCompar *cmp) {
+    // A buffer of about sqrt(n) elements. If it cannot be allocated, the elements that fit
+    // on the stack are used; with none, the merges rotate by reversals and the insertion
+    // pass, which needs one slot, is skipped.
+    size_t capacity = 1;
+    while (capacity * capacity < nitems) capacity++;
+    char stack_buffer[ELEM_STACK_MAX];
+    char *buffer = malloc(size * capacity);
+    if (!buffer) {
+        buffer = stack_buffer;
+        capacity = ELEM_STACK_MAX / size;
+    }
+    InPlaceMerge m = {(char *)base, size, cmp, buffer, capacity};
+
+    // Blocks of cutoff elements are sorted by insertion, then merged bottom-up
+    size_t cutoff = capacity > 0 ? sort_cutoff(size) : 1;
+    for (size_t low = 0; cutoff > 1 && low < nitems; low += cutoff) {
+        size_t count = nitems - low < cutoff ? nitems - low : cutoff;
+        elem_insertion_sort(at(&m, low), count, size, cmp, buffer);
+    }
+    for (size_t width = cutoff; width < nitems; width *= 2) {
+        for (size_t low = 0; low + width < nitems; low += 2 * width) {
+            size_t high = low + 2 * width < nitems ? low + 2 * width : nitems;
+            merge(&m, low, low + width, high);
+        }
+    }
+    if (buffer != stack_buffer) free(buffer);
+}
+
+// In-place merge sort function
+void inplace_merge_sort(void *base, size_t nitems, size_t size,
+                        int (*compar)(const void *, const void *)) {
+    // Base case: if the array has 0 or 1 item, or invalid parameters
+    if (nitems < 2 || base == NULL || size == 0 || compar == NULL) return;
+
+    SortCompar cmp = {compar, NULL, NULL};
+    inplace_merge_sort_with(base, nitems, size, &cmp);
+}
+
+// In-place merge sort function with a context argument for the comparison function
+void inplace_merge_sort_r(void *base, size_t nitems, size_t size,
+                          int (*compar)(const void *, const void *, void *), void *ctx) {
+    // Base case: if the array has 0 or 1 item, or invalid parameters
+    if (nitems < 2 || base == NULL || size == 0 || compar == NULL) return;
+
+    SortCompar cmp = {NULL, compar, ctx};
+    inplace_merge_sort_with(base, nitems, size, &cmp);
+}
@@ -0,0 +1,313 @@
+#include "sort.h"
+#include "sort_cutoff.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#else
+#define HAVE_AVX2_KERNEL 0
+#endif
+
+// Elements examined at a time on each side by the block partition
+#define BLOCK 64
+// Largest range sorted by the AVX2 sorting network
+#define NETWORK_MAX 64
+// Ranges at least this long use Tukey's ninther instead of a plain median of three
+#define NINTHER_THRESHOLD 128
+
+// Whether the AVX2 kernels may be used, on CPUs that support them
+static int avx2_enabled = 1;
+
+static inline void swap_values(int64_t *a, int64_t *b) {
+    int64_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+// Binary insertion sort of a[0 .. n)
+static void insertion_sort(int64_t *a, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        int64_t item = a[i];
+        if (!(item < a[i - 1])) continue;
+        size_t left = 0, right = i - 1;
+        while (left < right) {
+            size_t mid = left + (right - left) / 2;
+            if (item < a[mid])
+                right = mid;
+            else
+                left = mid + 1;
+        }
+        memmove(a + left + 1, a + left, sizeof(int64_t) * (i - left));
+        a[left] = item;
+    }
+}
+
+// Restore the max-heap property for the subtree rooted at index root
+static void sift_down(int64_t *a, size_t root, size_t n) {
+    size_t child;
+    while ((child = 2 * root + 1) < n) {
+        if (child + 1 < n && a[child] < a[child + 1]) child++;
+        if (!(a[root] < a[child])) return;
+        swap_values(a + root, a + child);
+        root = child;
+    }
+}
+
+// Heap sort, used when the recursion gets too deep
+static void heap_sort(int64_t *a, size_t n) {
+    for (size_t i = n / 2; i > 0; i--) sift_down(a, i - 1, n);
+    for (size_t end = n - 1; end > 0; end--) {
+        swap_values(a, a + end);
+        sift_down(a, 0, end);
+    }
+}
+
+#if HAVE_AVX2_KERNEL
+// Put the smaller of each pair of lanes of a and b in a, the larger in b
+__attribute__((target("avx2"))) static inline void vector_minmax(__m256i *a, __m256i *b) {
+    __m256i greater = _mm256_cmpgt_epi64(*a, *b);
+    __m256i min = _mm256_blendv_epi8(*a, *b, greater);
+    *b = _mm256_blendv_epi8(*b, *a, greater);
+    *a = min;
+}
+
+// Compare the lanes of v with the lanes given by a permutation, keeping the smaller
+// value in the lanes selected by mask (one bit per 32-bit half) and the larger in the
+// others
+#define VECTOR_EXCHANGE(v, permutation, mask)                                   \
+    do {                                                                        \
+        __m256i other_ = _mm256_permute4x64_epi64(v, permutation);              \
+        __m256i min_ = v;                                                       \
+        vector_minmax(&min_, &other_);                                          \
+        v = _mm256_blend_epi32(min_, other_, mask);                             \
+    } while (0)
+
+// Bitonic sorting network of 4 * nvec values held in v, nvec a power of two up to 16.
+// Every merge first compares each value with its mirror in the block, so all the
+// comparators of the network put the smaller value first.
+__attribute__((target("avx2"))) static void bitonic_network(__m256i *v, size_t nvec) {
+    size_t total = 4 * nvec;
+    for (size_t k = 2; k <= total; k *= 2) {
+        // Mirror stage: value i against value i ^ (k - 1)
+        if (k == 2) {
+            for (size_t i = 0; i < nvec; i++) VECTOR_EXCHANGE(v[i], 0xB1, 0xCC);
+        } else if (k == 4) {
+            for (size_t i = 0; i < nvec; i++) VECTOR_EXCHANGE(v[i], 0x1B, 0xF0);
+        } else {
+            size_t block = k / 4;
+            for (size_t b = 0; b < nvec; b += block) {
+                for (size_t j = 0; j < block / 2; j++) {
+                    __m256i low = v[b + j];
+                    __m256i high = _mm256_permute4x64_epi64(v[b + block - 1 - j], 0x1B);
+                    vector_minmax(&low, &high);
+                    v[b + j] = low;
+                    v[b + block - 1 - j] = _mm256_permute4x64_epi64(high, 0x1B);
+                }
+            }
+        }
+
+        // Half cleaners: value i against value i + d for d = k / 4, ..., 1
+        for (size_t d = k / 4; d >= 1; d /= 2) {
+            if (d >= 4) {
+                size_t dv = d / 4;
+                for (size_t i = 0; i < nvec; i++) {
+                    if (!(i & dv)) vector_minmax(&v[i], &v[i + dv]);
+                }
+            } else if (d == 2) {
+                for (size_t i = 0; i < nvec; i++) VECTOR_EXCHANGE(v[i], 0x4E, 0xF0);
+            } else {
+                for (size_t i = 0; i < nvec; i++) VECTOR_EXCHANGE(v[i], 0xB1, 0xCC);
+            }
+        }
+    }
+}
+
+// Sort a[0 .. n), n at most NETWORK_MAX, with the smallest bitonic network that holds
+// it; the unused lanes are padded with the largest value
+__attribute__((target("avx2"))) static void network_sort(int64_t *a, size_t n) {
+    int64_t padded[NETWORK_MAX];
+    __m256i v[NETWORK_MAX / 4];
+    size_t nvec = 1;
+    while (4 * nvec < n) nvec *= 2;
+
+    memcpy(padded, a, sizeof(int64_t) * n);
+    for (size_t i = n; i < 4 * nvec; i++) padded[i] = INT64_MAX;
+    for (size_t i = 0; i < nvec; i++) {
+        v[i] = _mm256_loadu_si256((const __m256i *)(padded + 4 * i));
+    }
+    bitonic_network(v, nvec);
+    for (size_t i = 0; i < nvec; i++) {
+        _mm256_storeu_si256((__m256i *)(padded + 4 * i), v[i]);
+    }
+    memcpy(a, padded, sizeof(int64_t) * n);
+}
+#endif
+
+// Whether the AVX2 kernels are used
+static int avx2_in_use(void) {
+#if HAVE_AVX2_KERNEL
+    return avx2_enabled && __builtin_cpu_supports("avx2");
+#else
+    return 0;
+#endif
+}
+
+// Sort a short range, with the sorting network if vector is set
+static void small_sort(int64_t *a, size_t n, int vector) {
+#if HAVE_AVX2_KERNEL
+    if (vector) {
+        network_sort(a, n);
+        return;
+    }
+#endif
+    (void)vector;
+    insertion_sort(a, n);
+}
+
+// Return the index of the median among the values at indices i, j and k
+static size_t median_of_three(const int64_t *a, size_t i, size_t j, size_t k) {
+    if (a[i] < a[j]) {
+        if (a[j] < a[k]) return j;
+        return a[i] < a[k] ? k : i;
+    }
+    if (a[i] < a[k]) return i;
+    return a[j] < a[k] ? k : j;
+}
+
+// Move a median of three (Tukey's ninther on long ranges) to a[0] as the pivot
+static void choose_pivot(int64_t *a, size_t n) {
+    size_t mid = n / 2, high = n - 1, pivot;
+    if (n >= NINTHER_THRESHOLD) {
+        size_t step = n / 8;
+        pivot = median_of_three(a, median_of_three(a, 0, step, 2 * step),
+                                median_of_three(a, mid - step, mid, mid + step),
+                                median_of_three(a, high - 2 * step, high - step, high));
+    } else {
+        pivot = median_of_three(a, 0, mid, high);
+    }
+    swap_values(a, a + pivot);
+}
+
+// Partition a[0 .. n) around the pivot in a[0] like BlockQuicksort: a block of BLOCK
+// values on each side is scanned without branches, recording the offsets of the values
+// on the wrong side, and the recorded values are then swapped in pairs. The remaining
+// middle is finished by a branchless Lomuto scan. Values less than the pivot end up
+// before it, the others after it; returns the final index of the pivot.
+static size_t block_partition(int64_t *a, size_t n) {
+    int64_t pivot = a[0];
+    unsigned char offsets_left[BLOCK], offsets_right[BLOCK];
+    size_t num_left = 0, num_right = 0, start_left = 0, start_right = 0;
+
+    // a[1 .. left) is less than the pivot, a(right .. n) is not, a[left .. right] unknown
+    size_t left = 1, right = n - 1;
+    while (right + 1 - left >= 2 * BLOCK) {
+        if (num_left == 0) {
+            start_left = 0;
+            for (size_t i = 0; i < BLOCK; i++) {
+                offsets_left[num_left] = (unsigned char)i;
+                num_left += !(a[left + i] < pivot);
+            }
+        }
+        if (num_right == 0) {
+            start_right = 0;
+            for (size_t i = 0; i < BLOCK; i++) {
+                offsets_right[num_right] = (unsigned char)i;
+                num_right += a[right - i] < pivot;
+            }
+        }
+
+        size_t num = num_left < num_right ? num_left : num_right;
+        for (size_t i = 0; i < num; i++) {
+            swap_values(a + left + offsets_left[start_left + i],
+                        a + right - offsets_right[start_right + i]);
+        }
+        num_left -= num;
+        num_right -= num;
+        start_left += num;
+        start_right += num;
+        if (num_left == 0) left += BLOCK;
+        if (num_right == 0) right -= BLOCK;
+    }
+
+    // Whatever the state of a half-done block, a[left .. right] only needs partitioning
+    size_t store = left;
+    for (size_t i = left; i <= right; i++) {
+        int64_t value = a[i];
+        int less = value < pivot;
+        a[i] = a[store];
+        a[store] = value;
+        store += less;
+    }
+
+    swap_values(a, a + store - 1);
+    return store - 1;
+}
+
+// Partition used when the pivot in a[0] equals the value just before the range, which
+// no value of the range is smaller than: the values equal to the pivot are put first
+// and are done. Returns the index of the last of them.
+static size_t partition_equal(int64_t *a, size_t n) {
+    int64_t pivot = a[0];
+    size_t store = 1;
+    for (size_t i = 1; i < n; i++) {
+        int64_t value = a[i];
+        int equal = !(pivot < value);
+        a[i] = a[store];
+        a[store] = value;
+        store += equal;
+    }
+    return store - 1;
+}
+
+// Introsort: recurse on the smaller side, heap sort once depth_limit runs out, and
+// finish ranges of at most cutoff values with small_sort(). If has_pred is set, a[-1]
+// is a value not greater than any value of the range.
+static void sort_range(int64_t *a, size_t n, size_t depth_limit, int has_pred,
+                       size_t cutoff, int vector) {
+    while (n > cutoff) {
+        if (depth_limit == 0) {
+            heap_sort(a, n);
+            return;
+        }
+        depth_limit--;
+        choose_pivot(a, n);
+
+        // Many values equal to the pivot: skip them all at once
+        if (has_pred && !(a[-1] < a[0])) {
+            size_t last = partition_equal(a, n);
+            a += last + 1;
+            n -= last + 1;
+            continue;
+        }
+
+        size_t p = block_partition(a, n);
+        if (p < n - 1 - p) {
+            sort_range(a, p, depth_limit, has_pred, cutoff, vector);
+            a += p + 1;
+            n -= p + 1;
+            has_pred = 1;
+        } else {
+            sort_range(a + p + 1, n - p - 1, depth_limit, 1, cutoff, vector);
+            n = p;
+        }
+    }
+    if (n > 1) small_sort(a, n, vector);
+}
+
+// Function to choose whether the AVX2 kernels are used
+int int64_sort_set_avx2(int enable) {
+    avx2_enabled = enable;
+    return avx2_in_use();
+}
+
+// Function to sort an array of 64-bit integers
+void int64_sort(int64_t *values, size_t nitems) {
+    if (nitems < 2 || values == NULL) return;
+
+    // The sorting network replaces insertion sort for ranges that fit in it
+    int vector = avx2_in_use();
+    size_t cutoff = vector ? NETWORK_MAX : sort_cutoff(sizeof(int64_t));
+    size_t depth_limit = 0;
+    for (size_t n = nitems; n > 1; n >>= 1) depth_limit += 2;
+    sort_range(values, nitems, depth_limit, 0, cutoff, vector);
+}
@@ -1,23 +1,191 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "quantiles.h"
 #include "record.h"
+#include "sort_cutoff.h"
+
+// Parse a size in bytes with an optional K, M or G suffix. Returns 0 if invalid.
+static size_t parse_size(const char *text) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    switch (*end) {
+        case 'K': case 'k': value <<= 10; end++; break;
+        case 'M': case 'm': value <<= 20; end++; break;
+        case 'G': case 'g': value <<= 30; end++; break;
+        default: break;
+    }
+    return (end == text || *end != '\0') ? 0 : (size_t)value;
+}
+
+// Split a comma-separated list in place into at most max items. Returns the number of
+// items, or 0 if there are more than max.
+static size_t split_list(char *text, char **items, size_t max) {
+    size_t count = 0;
+    for (char *item = text; item; count++) {
+        if (count == max) return 0;
+        items[count] = item;
+        item = strchr(item, ',');
+        if (item) *item++ = '\0';
+    }
+    return count;
+}
+
+// Most quantiles --quantiles accepts
+#define MAX_QUANTILES 32
+
+// Write the quantiles of a numeric field as "probability,value" lines, the probability
+// as it was given. Returns EXIT_SUCCESS or EXIT_FAILURE.
+static int write_quantiles(FILE *in, FILE *out, size_t field, char **texts,
+                           const double *probabilities, size_t count) {
+    double values[MAX_QUANTILES];
+    int result = record_quantiles(in, field, probabilities, count, values);
+    if (result != 0) {
+        fprintf(stderr, result > 0 ? "Error: the input holds no record\n"
+                                   : "Error: computing the quantiles failed\n");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (field == 2)
+            fprintf(out, "%s,%d\n", texts[i], (int)values[i]);
+        else
+            fprintf(out, "%s,%f\n", texts[i], (float)values[i]);
+    }
+    return EXIT_SUCCESS;
+}
+
+// Calibrate the insertion sort cutoff for a field and write all the cutoffs set so far.
+// Returns EXIT_SUCCESS or EXIT_FAILURE.
+static int write_cutoffs(FILE *in, FILE *out, size_t field) {
+    if (calibrate_record_cutoff(in, out, field) != 0) {
+        fprintf(stderr, "Error: calibrating the insertion sort cutoff failed\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
-        fprintf(stderr, "Usage: %s <input.csv> <output.csv> <field> <algo>\n", argv[0]);
+    if (argc < 5) {
+        fprintf(stderr, "Usage: %s <input.csv|input.bin> <output.csv>[,<output.csv>...]"
+                        " <field>[,<field>...] <algo> [--indirect] [--compact] [--threads N]"
+                        " [--max-memory BYTES[K|M|G]] [--tmp-dir DIR] [--limit K] [--quantiles P[,P...]]"
+                        " [--cutoffs FILE] [--calibrate]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Several fields, each with its own output, are sorted after a single parse
+    char *outputs[3], *field_args[3];
+    size_t noutputs = split_list(argv[2], outputs, 3);
+    size_t nfields = split_list(argv[3], field_args, 3);
+    if (nfields == 0 || noutputs != nfields) {
+        fprintf(stderr, "Error: give one to three fields and as many output files\n");
         exit(EXIT_FAILURE);
     }
 
-    int field = atoi(argv[3]);
     int algo = atoi(argv[4]);
 
-    if (field < 1 || field > 3) {
-        fprintf(stderr, "Error: field must be 1, 2, or 3\n");
+    if (algo < 0 || algo > 5) {
+        fprintf(stderr, "Error: algorithm must be 0 (auto), 1 (merge), 2 (quick), 3 (tim), 4 (string)"
+                        " or 5 (in-place merge)\n");
         exit(EXIT_FAILURE);
     }
 
-    if (algo != 1 && algo != 2) {
-        fprintf(stderr, "Error: algorithm must be 1 (merge) or 2 (quick)\n");
+    size_t fields[3];
+    for (size_t i = 0; i < nfields; i++) {
+        int field = atoi(field_args[i]);
+
+        if (field < 1 || field > 3) {
+            fprintf(stderr, "Error: field must be 1, 2, or 3\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (algo == 4 && field != 1) {
+            fprintf(stderr, "Error: algorithm 4 (string) can only sort by field 1\n");
+            exit(EXIT_FAILURE);
+        }
+        fields[i] = (size_t)field;
+    }
+
+    SortOptions options = {.field = fields[0], .algo = (size_t)algo, .threads = 1};
+    char *quantile_texts[MAX_QUANTILES];
+    double probabilities[MAX_QUANTILES];
+    size_t nquantiles = 0;
+    int calibrate = 0;
+
+    // Optional flags after the positional arguments
+    for (int i = 5; i < argc; i++) {
+        if (strcmp(argv[i], "--indirect") == 0) {
+            options.indirect = 1;
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            options.compact = 1;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            int threads = atoi(argv[++i]);
+            if (threads < 1) {
+                fprintf(stderr, "Error: --threads must be at least 1\n");
+                exit(EXIT_FAILURE);
+            }
+            options.threads = (size_t)threads;
+        } else if (strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc) {
+            options.max_memory = parse_size(argv[++i]);
+            if (options.max_memory == 0) {
+                fprintf(stderr, "Error: invalid --max-memory value '%s'\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+            char *end;
+            options.limit = strtoull(argv[++i], &end, 10);
+            if (options.limit == 0 || *end != '\0' || argv[i][0] == '-') {
+                fprintf(stderr, "Error: --limit must be a positive number of records\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--quantiles") == 0 && i + 1 < argc) {
+            // Probabilities between 0 and 1, written to the output instead of the records
+            nquantiles = split_list(argv[++i], quantile_texts, MAX_QUANTILES);
+            for (size_t q = 0; q < nquantiles; q++) {
+                char *end;
+                probabilities[q] = strtod(quantile_texts[q], &end);
+                if (end == quantile_texts[q] || *end != '\0' ||
+                    !(probabilities[q] >= 0.0 && probabilities[q] <= 1.0)) {
+                    nquantiles = 0;
+                }
+            }
+            if (nquantiles == 0) {
+                fprintf(stderr, "Error: --quantiles takes up to %d probabilities between 0 and 1\n",
+                        MAX_QUANTILES);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--cutoffs") == 0 && i + 1 < argc) {
+            // Insertion sort cutoffs saved by an earlier --calibrate run
+            FILE *cutoffs = fopen(argv[++i], "r");
+            int loaded = cutoffs && sort_load_cutoffs(cutoffs) == 0;
+            if (cutoffs) fclose(cutoffs);
+            if (!loaded) {
+                fprintf(stderr, "Error: unable to load the cutoffs in '%s'\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--calibrate") == 0) {
+            // Measure the insertion sort cutoff and write the cutoffs to the output
+            calibrate = 1;
+        } else if (strcmp(argv[i], "--tmp-dir") == 0 && i + 1 < argc) {
+            options.tmp_dir = argv[++i];
+        } else {
+            fprintf(stderr, "Error: unknown option '%s'\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (nfields > 1 && (options.max_memory > 0 || options.limit > 0)) {
+        fprintf(stderr, "Error: --max-memory and --limit sort a single field at a time\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (calibrate && (nfields > 1 || nquantiles > 0)) {
+        fprintf(stderr, "Error: --calibrate needs a single field and no --quantiles\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (nquantiles > 0 && (nfields > 1 || fields[0] == 1)) {
+        fprintf(stderr, "Error: --quantiles needs a single numeric field (2 or 3)\n");
         exit(EXIT_FAILURE);
     }
 
@@ -27,18 +195,30 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    FILE *out = fopen(argv[2], "w");
-    if (!out) {
-        fprintf(stderr, "Error: Unable to open output file '%s'\n", argv[2]);
-        fclose(in);
-        exit(EXIT_FAILURE);
+    FILE *out[3];
+    for (size_t i = 0; i < nfields; i++) {
+        out[i] = fopen(outputs[i], "w");
+        if (!out[i]) {
+            fprintf(stderr, "Error: Unable to open output file '%s'\n", outputs[i]);
+            fclose(in);
+            while (i > 0) fclose(out[--i]);
+            exit(EXIT_FAILURE);
+        }
     }
 
     // Start the sorting process
-    sort_records(in, out, field, algo);
+    int status = EXIT_SUCCESS;
+    if (calibrate)
+        status = write_cutoffs(in, out[0], fields[0]);
+    else if (nquantiles > 0)
+        status = write_quantiles(in, out[0], fields[0], quantile_texts, probabilities, nquantiles);
+    else if (nfields == 1 && sort_records_with(in, out[0], &options) != 0)
+        status = EXIT_FAILURE;
+    else if (nfields > 1 && sort_records_multi(in, out, fields, nfields, &options) != 0)
+        status = EXIT_FAILURE;
 
     fclose(in);
-    fclose(out);
+    for (size_t i = 0; i < nfields; i++) fclose(out[i]);
 
-    exit(EXIT_SUCCESS);
+    exit(status);
 }
@@ -1,41 +1,100 @@
 #include <string.h>
 #include "sort.h"
+#include "sort_cutoff.h"
+#include "sort_elem.h"
+
+// Merge the sorted runs left[0..left_count) and right[0..right_count) into dest
+static void merge(char *dest, size_t size, const SortCompar *cmp, const char *left,
+                  size_t left_count, const char *right, size_t right_count) {
+    // If the two runs are already in order, copy them over as they are
+    if (sort_compare(cmp, left + (left_count - 1) * size, right) <= 0) {
+        memcpy(dest, left, size * left_count);
+        memcpy(dest + size * left_count, right, size * right_count);
+        return;
+    }
 
-// Merge two sorted halves into a temporary array, then copy back into base
-static void merge(void *base, size_t size, int (*compar)(const void *, const void *),
-                  char *left, size_t left_count, char *right, size_t right_count) {
-    // Allocate temporary array to hold merged result
-    char *temp = malloc(size * (left_count + right_count));
     size_t i = 0, j = 0, k = 0;
 
-    // Merge elements from left and right into temp
+    // Merge elements from left and right into dest
     while (i < left_count && j < right_count) {
-        if (compar(left + i * size, right + j * size) <= 0)
-            memcpy(temp + k++ * size, left + i++ * size, size);
+        if (sort_compare(cmp, left + i * size, right + j * size) <= 0)
+            elem_copy(dest + k++ * size, left + i++ * size, size);
         else
-            memcpy(temp + k++ * size, right + j++ * size, size);
+            elem_copy(dest + k++ * size, right + j++ * size, size);
     }
 
     // Copy any remaining elements from left
-    while (i < left_count) memcpy(temp + k++ * size, left + i++ * size, size);
+    memcpy(dest + k * size, left + i * size, size * (left_count - i));
+    k += left_count - i;
     // Copy any remaining elements from right
-    while (j < right_count) memcpy(temp + k++ * size, right + j++ * size, size);
+    memcpy(dest + k * size, right + j * size, size * (right_count - j));
+}
+
+// Bottom-up merge sort: blocks of cutoff elements are sorted by binary insertion, then
+// runs of width cutoff, 2 * cutoff, ... are merged pairwise, and each pass reads from
+// one of the two arrays and writes into the other
+static void merge_sort_with(void *base, size_t nitems, size_t size, const SortCompar *cmp) {
+    // Single auxiliary buffer shared by every pass; without it, sort in place
+    char *buffer = malloc(size * nitems);
+    if (!buffer) {
+        inplace_merge_sort_with(base, nitems, size, cmp);
+        return;
+    }
+
+    char *src = (char *)base;
+    char *dst = buffer;
+
+    size_t cutoff = sort_cutoff(size);
+    if (cutoff > 1) {
+        for (size_t low = 0; low < nitems; low += cutoff) {
+            size_t count = nitems - low < cutoff ? nitems - low : cutoff;
+            elem_insertion_sort(src + low * size, count, size, cmp, buffer);
+        }
+    }
+
+    for (size_t width = cutoff; width < nitems; width *= 2) {
+        for (size_t low = 0; low < nitems; low += 2 * width) {
+            size_t mid = low + width < nitems ? low + width : nitems;
+            size_t high = low + 2 * width < nitems ? low + 2 * width : nitems;
 
-    // Copy merged result back to base
-    memcpy(base, temp, size * (left_count + right_count));
-    free(temp);
+            if (mid == high) {
+                // Lone run at the end of the array, carry it over to the next pass
+                memcpy(dst + low * size, src + low * size, size * (high - low));
+            } else {
+                merge(dst + low * size, size, cmp, src + low * size, mid - low,
+                      src + mid * size, high - mid);
+            }
+        }
+
+        // The output of this pass is the input of the next one
+        char *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    // Copy the result back if the last pass ended in the buffer
+    if (src != (char *)base) {
+        memcpy(base, src, size * nitems);
+    }
+    free(buffer);
 }
 
-// Recursive merge sort function
+// Merge sort function
 void merge_sort(void *base, size_t nitems, size_t size,
                 int (*compar)(const void *, const void *)) {
     // Base case: if the array has 0 or 1 item, or invalid parameters
     if (nitems < 2 || base == NULL || size == 0 || compar == NULL) return;
-    size_t mid = nitems / 2;
-    // Cast base to char * for pointer arithmetic
-    char *b = (char *)base;
 
-    merge_sort(b, mid, size, compar);
-    merge_sort(b + mid * size, nitems - mid, size, compar);
-    merge(b, size, compar, b, mid, b + mid * size, nitems - mid);
+    SortCompar cmp = {compar, NULL, NULL};
+    merge_sort_with(base, nitems, size, &cmp);
+}
+
+// Merge sort function with a context argument for the comparison function
+void merge_sort_r(void *base, size_t nitems, size_t size,
+                  int (*compar)(const void *, const void *, void *), void *ctx) {
+    // Base case: if the array has 0 or 1 item, or invalid parameters
+    if (nitems < 2 || base == NULL || size == 0 || compar == NULL) return;
+
+    SortCompar cmp = {NULL, compar, ctx};
+    merge_sort_with(base, nitems, size, &cmp);
 }
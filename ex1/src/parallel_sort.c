@@ -0,0 +1,176 @@
+#include <string.h>
+#include "sort.h"
+#include "sort_elem.h"
+#include "thread_pool.h"
+
+// Ranges of at most this many elements are sorted or merged by a single thread
+#define PARALLEL_GRAIN 16384
+// Upper bound on the pieces a parallel merge is split into, per thread
+#define MERGE_CHUNKS_PER_THREAD 4
+
+// Parameters shared by all the tasks of one parallel_merge_sort() call
+typedef struct {
+    ThreadPool *pool;
+    size_t size;
+    int (*compar)(const void *, const void *);
+} SortContext;
+
+// Sort src[0 .. nitems), leaving the result in dst if into_dst is set, in src otherwise.
+// The other array is used as scratch space for the same range.
+typedef struct {
+    const SortContext *ctx;
+    char *src;
+    char *dst;
+    size_t nitems;
+    int into_dst;
+} SortTask;
+
+// Write positions [out_begin, out_end) of the merge of left and right into dest
+typedef struct {
+    const SortContext *ctx;
+    const char *left;
+    size_t left_count;
+    const char *right;
+    size_t right_count;
+    char *dest;
+    size_t out_begin;
+    size_t out_end;
+} MergeTask;
+
+// Number of elements taken from left among the first k elements of the stable merge
+// of left and right (left wins ties), found by binary search
+static size_t co_rank(size_t k, const char *left, size_t left_count, const char *right,
+                      size_t right_count, size_t size, int (*compar)(const void *, const void *)) {
+    size_t low = k > right_count ? k - right_count : 0;
+    size_t high = k < left_count ? k : left_count;
+
+    // Find the smallest i such that left[i] does not belong before right[k - i - 1]
+    while (low < high) {
+        size_t i = low + (high - low) / 2;
+        size_t j = k - i;
+        if (j > 0 && compar(left + i * size, right + (j - 1) * size) <= 0)
+            low = i + 1;
+        else
+            high = i;
+    }
+    return low;
+}
+
+// Sequential stable merge of left[0 .. left_count) and right[0 .. right_count) into dest
+static void merge_sequential(char *dest, const char *left, size_t left_count,
+                             const char *right, size_t right_count, size_t size,
+                             int (*compar)(const void *, const void *)) {
+    size_t i = 0, j = 0;
+    while (i < left_count && j < right_count) {
+        if (compar(left + i * size, right + j * size) <= 0) {
+            elem_copy(dest, left + i++ * size, size);
+        } else {
+            elem_copy(dest, right + j++ * size, size);
+        }
+        dest += size;
+    }
+    memcpy(dest, left + i * size, size * (left_count - i));
+    dest += size * (left_count - i);
+    memcpy(dest, right + j * size, size * (right_count - j));
+}
+
+// Task body: merge one slice of the output
+static void merge_task(void *arg) {
+    const MergeTask *task = (const MergeTask *)arg;
+    size_t size = task->ctx->size;
+    int (*compar)(const void *, const void *) = task->ctx->compar;
+
+    size_t i0 = co_rank(task->out_begin, task->left, task->left_count, task->right,
+                        task->right_count, size, compar);
+    size_t i1 = co_rank(task->out_end, task->left, task->left_count, task->right,
+                        task->right_count, size, compar);
+    size_t j0 = task->out_begin - i0;
+    size_t j1 = task->out_end - i1;
+
+    merge_sequential(task->dest + task->out_begin * size, task->left + i0 * size, i1 - i0,
+                     task->right + j0 * size, j1 - j0, size, compar);
+}
+
+// Merge two sorted runs into dest, splitting large merges into independent slices of
+// the output whose inputs are located by co-ranking
+static void parallel_merge(const SortContext *ctx, char *dest, const char *left,
+                           size_t left_count, const char *right, size_t right_count) {
+    size_t nitems = left_count + right_count;
+    size_t chunks = nitems / PARALLEL_GRAIN;
+    size_t max_chunks = MERGE_CHUNKS_PER_THREAD * thread_pool_size(ctx->pool);
+    if (chunks > max_chunks) chunks = max_chunks;
+
+    MergeTask *tasks = chunks > 1 ? malloc(sizeof(MergeTask) * chunks) : NULL;
+    if (!tasks) {
+        merge_sequential(dest, left, left_count, right, right_count, ctx->size, ctx->compar);
+        return;
+    }
+
+    TaskGroup group = TASK_GROUP_INIT;
+    for (size_t c = 0; c < chunks; c++) {
+        MergeTask task = {ctx, left, left_count, right, right_count, dest,
+                          nitems * c / chunks, nitems * (c + 1) / chunks};
+        tasks[c] = task;
+        if (c + 1 < chunks) thread_pool_spawn(ctx->pool, &group, merge_task, &tasks[c]);
+    }
+    merge_task(&tasks[chunks - 1]);
+    thread_pool_wait(ctx->pool, &group);
+    free(tasks);
+}
+
+// Task body: sort one range, spawning the left half and recursing on the right one
+static void sort_task(void *arg) {
+    const SortTask *task = (const SortTask *)arg;
+    const SortContext *ctx = task->ctx;
+    size_t size = ctx->size;
+
+    if (task->nitems <= PARALLEL_GRAIN) {
+        merge_sort(task->src, task->nitems, size, ctx->compar);
+        if (task->into_dst) memcpy(task->dst, task->src, size * task->nitems);
+        return;
+    }
+
+    // Sort both halves into the array that is not the destination of this range
+    size_t mid = task->nitems / 2;
+    SortTask left = {ctx, task->src, task->dst, mid, !task->into_dst};
+    SortTask right = {ctx, task->src + mid * size, task->dst + mid * size,
+                      task->nitems - mid, !task->into_dst};
+
+    TaskGroup group = TASK_GROUP_INIT;
+    thread_pool_spawn(ctx->pool, &group, sort_task, &left);
+    sort_task(&right);
+    thread_pool_wait(ctx->pool, &group);
+
+    // Then merge them into the destination
+    char *from = task->into_dst ? task->src : task->dst;
+    char *to = task->into_dst ? task->dst : task->src;
+    parallel_merge(ctx, to, from, mid, from + mid * size, task->nitems - mid);
+}
+
+// Parallel merge sort function
+void parallel_merge_sort(void *base, size_t nitems, size_t size,
+                         int (*compar)(const void *, const void *), size_t nthreads) {
+    // Base case: if the array has 0 or 1 item, or invalid parameters
+    if (nitems < 2 || base == NULL || size == 0 || compar == NULL) return;
+
+    // Not worth starting threads: use the sequential sort
+    if (nthreads <= 1 || nitems <= PARALLEL_GRAIN) {
+        merge_sort(base, nitems, size, compar);
+        return;
+    }
+
+    char *buffer = malloc(size * nitems);
+    ThreadPool *pool = buffer ? thread_pool_create(nthreads) : NULL;
+    if (!pool) {
+        free(buffer);
+        merge_sort(base, nitems, size, compar);
+        return;
+    }
+
+    SortContext ctx = {pool, size, compar};
+    SortTask root = {&ctx, (char *)base, buffer, nitems, 0};
+    sort_task(&root);
+
+    thread_pool_free(pool);
+    free(buffer);
+}
@@ -0,0 +1,93 @@
+#include <math.h>
+#include <stdlib.h>
+#include "quantiles.h"
+#include "record_stream.h"
+#include "sort_template.h"
+
+// Records read from the input at a time
+#define QUANTILE_CHUNK 4096
+// Initial capacity of the key array
+#define INITIAL_KEYS 65536
+
+SORT_DEFINE(int_value, int, *a < *b)
+SORT_DEFINE(float_value, float, *a < *b)
+
+// Load the keys of a numeric field into an array of ints (field 2) or floats (field 3),
+// both 4 bytes wide. Returns the array (to be freed), or NULL if memory runs out or
+// the input cannot be used.
+static void *load_keys(FILE *infile, size_t field, size_t *count) {
+    RecordStream stream;
+    if (record_stream_open(&stream, infile) != 0) return NULL;
+
+    size_t capacity = INITIAL_KEYS;
+    char *keys = malloc(4 * capacity);
+    Record *chunk = malloc(sizeof(Record) * QUANTILE_CHUNK);
+    int failed = !keys || !chunk;
+
+    *count = 0;
+    size_t read = QUANTILE_CHUNK;
+    while (!failed && read == QUANTILE_CHUNK) {
+        read = record_stream_read(&stream, chunk, QUANTILE_CHUNK);
+        if (capacity - *count < read) {
+            char *grown = realloc(keys, 4 * capacity * 2);
+            failed = !grown;
+            if (failed) break;
+            keys = grown;
+            capacity *= 2;
+        }
+        for (size_t i = 0; i < read; i++, (*count)++) {
+            if (field == 2)
+                ((int *)keys)[*count] = chunk[i].field2;
+            else
+                ((float *)keys)[*count] = chunk[i].field3;
+        }
+    }
+
+    record_stream_close(&stream);
+    free(chunk);
+    if (failed) {
+        free(keys);
+        return NULL;
+    }
+    return keys;
+}
+
+// Function to compute quantiles of a numeric field of the records of a file
+int record_quantiles(FILE *infile, size_t field, const double *probabilities, size_t count,
+                     double *values) {
+    size_t nkeys = 0;
+    void *keys = load_keys(infile, field, &nkeys);
+    size_t *ranks = malloc(sizeof(size_t) * (count > 0 ? count : 1));
+    size_t *sorted = malloc(sizeof(size_t) * (count > 0 ? count : 1));
+    int result = keys && ranks && sorted ? 0 : -1;
+    if (result == 0 && nkeys == 0) result = 1;
+
+    if (result == 0) {
+        // Nearest rank of each probability, counting from 0
+        for (size_t i = 0; i < count; i++) {
+            double position = ceil(probabilities[i] * (double)nkeys);
+            ranks[i] = position < 1.0 ? 0 : (size_t)position - 1;
+            if (ranks[i] >= nkeys) ranks[i] = nkeys - 1;
+        }
+
+        // The multi-select wants the ranks in order: insertion sort the few of them
+        for (size_t i = 0; i < count; i++) {
+            size_t j = i;
+            for (; j > 0 && sorted[j - 1] > ranks[i]; j--) sorted[j] = sorted[j - 1];
+            sorted[j] = ranks[i];
+        }
+
+        if (field == 2) {
+            int_value_multi_select(keys, nkeys, sorted, count);
+            for (size_t i = 0; i < count; i++) values[i] = ((int *)keys)[ranks[i]];
+        } else {
+            float_value_multi_select(keys, nkeys, sorted, count);
+            for (size_t i = 0; i < count; i++) values[i] = ((float *)keys)[ranks[i]];
+        }
+    }
+
+    free(keys);
+    free(ranks);
+    free(sorted);
+    return result;
+}
@@ -1,64 +1,211 @@
 #include <string.h>
 #include "sort.h"
+#include "sort_cutoff.h"
+#include "sort_elem.h"
 
-// Function to swap two elements in an array
-static void swap(void *a, void *b, size_t size) {
-    char temp[size];
-    memcpy(temp, a, size);
-    memcpy(a, b, size);
-    memcpy(b, temp, size);
+// Ranges at least this long use Tukey's ninther instead of a plain median of three
+#define NINTHER_THRESHOLD 128
+
+// Return the index of the median among the elements at indices a, b and c
+static size_t median_of_three(char *arr, size_t a, size_t b, size_t c, size_t size,
+                              const SortCompar *cmp) {
+    if (sort_compare(cmp, arr + a * size, arr + b * size) < 0) {
+        if (sort_compare(cmp, arr + b * size, arr + c * size) < 0) return b;
+        return sort_compare(cmp, arr + a * size, arr + c * size) < 0 ? c : a;
+    }
+    if (sort_compare(cmp, arr + a * size, arr + c * size) < 0) return a;
+    return sort_compare(cmp, arr + b * size, arr + c * size) < 0 ? c : b;
+}
+
+// Choose the pivot index for the range [low, high]: median of three on short
+// ranges, Tukey's ninther (median of three medians) on long ones
+static size_t choose_pivot(char *arr, size_t low, size_t high, size_t size,
+                           const SortCompar *cmp) {
+    size_t n = high - low + 1;
+    size_t mid = low + n / 2;
+
+    if (n >= NINTHER_THRESHOLD) {
+        size_t step = n / 8;
+        size_t a = median_of_three(arr, low, low + step, low + 2 * step, size, cmp);
+        size_t b = median_of_three(arr, mid - step, mid, mid + step, size, cmp);
+        size_t c = median_of_three(arr, high - 2 * step, high - step, high, size, cmp);
+        return median_of_three(arr, a, b, c, size, cmp);
+    }
+    return median_of_three(arr, low, mid, high, size, cmp);
 }
 
-// Function to partition the array for quick sor
-static size_t partition(void *base, size_t low, size_t high, size_t size, 
-                        int (*compar)(const void *, const void *)) {
-    
-    // Choose the last element as the pivot
+// Restore the max-heap property for the subtree rooted at index root
+static void sift_down(char *arr, size_t root, size_t nitems, size_t size,
+                      const SortCompar *cmp) {
+    size_t child;
+    while ((child = 2 * root + 1) < nitems) {
+        // Pick the larger of the two children
+        if (child + 1 < nitems &&
+            sort_compare(cmp, arr + child * size, arr + (child + 1) * size) < 0)
+            child++;
+        if (sort_compare(cmp, arr + root * size, arr + child * size) >= 0) return;
+        elem_swap(arr + root * size, arr + child * size, size);
+        root = child;
+    }
+}
+
+// Heap sort, used when quick sort recursion gets too deep
+static void heap_sort(char *arr, size_t nitems, size_t size,
+                      const SortCompar *cmp) {
+    // Build the max-heap bottom-up
+    for (size_t i = nitems / 2; i > 0; i--) {
+        sift_down(arr, i - 1, nitems, size, cmp);
+    }
+    // Repeatedly move the maximum to the end of the unsorted region
+    for (size_t end = nitems - 1; end > 0; end--) {
+        elem_swap(arr, arr + end * size, size);
+        sift_down(arr, 0, end, size, cmp);
+    }
+}
+
+// Swap n consecutive elements starting at a with the n starting at b
+static void swap_range(char *a, char *b, size_t n, size_t size) {
+    for (size_t k = 0; k < n; k++) {
+        elem_swap(a + k * size, b + k * size, size);
+    }
+}
+
+// Function to partition the array for quick sort. Uses the Bentley-McIlroy
+// three-way scheme: keys equal to the pivot are collected at both ends while
+// scanning and then swapped into the middle, so every key equal to the pivot
+// is in its final position after one pass. The equal range is returned in
+// [*eq_low, *eq_high].
+static void partition(void *base, size_t low, size_t high, size_t size,
+                      const SortCompar *cmp,
+                      size_t *eq_low, size_t *eq_high) {
+
+    // Move the chosen pivot to the first position
     char *arr = (char *)base;
-    void *pivot = arr + high * size;
-    
-    // Index i starts from low
-    size_t i = low;
-    
-    // Iterate through the array from low to high - 1
-    for (size_t j = low; j < high; j++) {
-        void *current = arr + j * size;
-        
-        // If the current element is less than or equal to the pivot, swap it with the element at index i
-        if (compar(current, pivot) <= 0) {
-            swap(arr + i * size, arr + j * size, size);
-            i++;
+    size_t pivot_choice = choose_pivot(arr, low, high, size, cmp);
+    if (pivot_choice != low) {
+        elem_swap(arr + pivot_choice * size, arr + low * size, size);
+    }
+    void *pivot = arr + low * size;
+
+    // [low, a) and (d, high] hold keys equal to the pivot,
+    // [a, b) keys less than it and (c, d] keys greater than it
+    size_t a = low + 1, b = low + 1;
+    size_t c = high, d = high;
+    int r;
+
+    for (;;) {
+        while (b <= c && (r = sort_compare(cmp, arr + b * size, pivot)) <= 0) {
+            if (r == 0) {
+                elem_swap(arr + a * size, arr + b * size, size);
+                a++;
+            }
+            b++;
+        }
+        while (b <= c && (r = sort_compare(cmp, arr + c * size, pivot)) >= 0) {
+            if (r == 0) {
+                elem_swap(arr + c * size, arr + d * size, size);
+                d--;
+            }
+            c--;
         }
+        if (b > c) break;
+        elem_swap(arr + b * size, arr + c * size, size);
+        b++;
+        c--;
     }
 
-    // Swap the pivot element with the element at index i
-    swap(arr + i * size, arr + high * size, size);
-    
-    // Return the index of the pivot
-    return i;
+    // Move the equal keys from both ends into the middle
+    size_t left_eq = a - low, less = b - a;
+    size_t n = left_eq < less ? left_eq : less;
+    swap_range(arr + low * size, arr + (b - n) * size, n, size);
+
+    size_t right_eq = high - d, greater = d - c;
+    n = right_eq < greater ? right_eq : greater;
+    swap_range(arr + b * size, arr + (high + 1 - n) * size, n, size);
+
+    *eq_low = low + less;
+    *eq_high = high - greater;
 }
 
-// Recursive function to perform quick sort
-static void quick_sort_recursive(void *base, size_t low, size_t high, size_t size, 
-                                 int (*compar)(const void *, const void *)) {
-    if (low < high) {
-      size_t pivot_index = partition(base, low, high, size, compar);
-
-      // Sort the elements before pivot
-      if (pivot_index > 0) {
-          quick_sort_recursive(base, low, pivot_index - 1, size, compar);
-      }
-      // Sort the elements after pivot
-      quick_sort_recursive(base, pivot_index + 1, high, size, compar);
+// Recursive function to perform quick sort. Only the smaller side of each
+// partition is recursed into, so the stack depth stays O(log n); once
+// depth_limit partitions have been made the range is finished with heap sort.
+// Ranges of at most cutoff elements are finished by binary insertion, through tmp.
+static void quick_sort_recursive(void *base, size_t low, size_t high, size_t size,
+                                 const SortCompar *cmp, size_t depth_limit,
+                                 size_t cutoff, char *tmp) {
+    char *arr = (char *)base;
+
+    while (low < high) {
+        if (high - low < cutoff) {
+            elem_insertion_sort(arr + low * size, high - low + 1, size, cmp, tmp);
+            return;
+        }
+        if (depth_limit == 0) {
+            heap_sort(arr + low * size, high - low + 1, size, cmp);
+            return;
+        }
+        depth_limit--;
+
+        size_t eq_low, eq_high;
+        partition(base, low, high, size, cmp, &eq_low, &eq_high);
+
+        if (eq_low - low < high - eq_high) {
+            // Sort the elements before the pivot run, then loop on the ones after it
+            if (eq_low > low) {
+                quick_sort_recursive(base, low, eq_low - 1, size, cmp, depth_limit, cutoff,
+                                     tmp);
+            }
+            low = eq_high + 1;
+        } else {
+            // Sort the elements after the pivot run, then loop on the ones before it
+            if (eq_high < high) {
+                quick_sort_recursive(base, eq_high + 1, high, size, cmp, depth_limit, cutoff,
+                                     tmp);
+            }
+            if (eq_low == low) return;
+            high = eq_low - 1;
+        }
     }
 }
 
+// Sort base[0 .. nitems) with at least two items
+static void quick_sort_with(void *base, size_t nitems, size_t size, const SortCompar *cmp) {
+    // Allow about 2 * log2(n) levels of partitioning before switching to heap sort
+    size_t depth_limit = 0;
+    for (size_t n = nitems; n > 1; n >>= 1) depth_limit += 2;
+
+    // Insertion sort needs room for one element: on the stack up to ELEM_STACK_MAX bytes,
+    // otherwise allocated (and skipped if that fails)
+    size_t cutoff = sort_cutoff(size);
+    char stack_tmp[ELEM_STACK_MAX];
+    char *tmp = stack_tmp;
+    if (size > sizeof(stack_tmp)) {
+        tmp = malloc(size);
+        if (!tmp) cutoff = 1;
+    }
+
+    // Call the recursive quick sort function
+    quick_sort_recursive(base, 0, nitems - 1, size, cmp, depth_limit, cutoff, tmp);
+    if (tmp != stack_tmp) free(tmp);
+}
+
 // Quick sort function
 void quick_sort(void *base, size_t nitems, size_t size,
                 int (*compar)(const void *, const void *)) {
     // Base case: if the array has 0 or 1 item, or invalid parameters
     if (nitems < 2 || base == NULL || size == 0 || compar == NULL) return;
 
-    // Call the recursive quick sort function
-    quick_sort_recursive(base, 0, nitems - 1, size, compar);
+    SortCompar cmp = {compar, NULL, NULL};
+    quick_sort_with(base, nitems, size, &cmp);
+}
+
+// Quick sort function with a context argument for the comparison function
+void quick_sort_r(void *base, size_t nitems, size_t size,
+                  int (*compar)(const void *, const void *, void *), void *ctx) {
+    // Base case: if the array has 0 or 1 item, or invalid parameters
+    if (nitems < 2 || base == NULL || size == 0 || compar == NULL) return;
+
+    SortCompar cmp = {NULL, compar, ctx};
+    quick_sort_with(base, nitems, size, &cmp);
 }
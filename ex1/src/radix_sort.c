@@ -0,0 +1,62 @@
+#include <string.h>
+#include "sort.h"
+
+// Keys are processed in three digits of 11, 11 and 10 bits
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1u << RADIX_BITS)
+#define RADIX_MASK (RADIX_BUCKETS - 1)
+#define RADIX_PASSES 3
+
+// LSD radix sort of (key, index) pairs
+int radix_sort_pairs(RadixPair *pairs, size_t nitems) {
+    // Base case: if the array has 0 or 1 item, or invalid parameters
+    if (nitems < 2 || pairs == NULL) return 0;
+
+    RadixPair *buffer = malloc(sizeof(RadixPair) * nitems);
+    if (!buffer) return -1;
+
+    // Histograms of every digit, computed together in a single pass
+    size_t counts[RADIX_PASSES][RADIX_BUCKETS];
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < nitems; i++) {
+        uint32_t key = pairs[i].key;
+        counts[0][key & RADIX_MASK]++;
+        counts[1][(key >> RADIX_BITS) & RADIX_MASK]++;
+        counts[2][key >> (2 * RADIX_BITS)]++;
+    }
+
+    RadixPair *src = pairs;
+    RadixPair *dst = buffer;
+
+    for (size_t pass = 0; pass < RADIX_PASSES; pass++) {
+        unsigned shift = (unsigned)(pass * RADIX_BITS);
+        size_t *count = counts[pass];
+
+        // Every key has the same digit here: this pass would not move anything
+        if (count[(src[0].key >> shift) & RADIX_MASK] == nitems) continue;
+
+        // Turn the histogram into the starting offset of each bucket
+        size_t offset = 0;
+        for (size_t b = 0; b < RADIX_BUCKETS; b++) {
+            size_t c = count[b];
+            count[b] = offset;
+            offset += c;
+        }
+
+        // Stable scatter into the other array
+        for (size_t i = 0; i < nitems; i++) {
+            dst[count[(src[i].key >> shift) & RADIX_MASK]++] = src[i];
+        }
+
+        RadixPair *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    // Copy the result back if the last pass ended in the buffer
+    if (src != pairs) {
+        memcpy(pairs, src, sizeof(RadixPair) * nitems);
+    }
+    free(buffer);
+    return 0;
+}
@@ -1,57 +1,818 @@
 #include "record.h"
+#include "compact_record.h"
+#include "csv_reader.h"
+#include "csv_writer.h"
+#include "external_sort.h"
+#include "record_file.h"
+#include "record_stream.h"
 #include "sort.h"
+#include "sort_cutoff.h"
+#include "sort_elem.h"
+#include "sort_template.h"
+#include "thread_pool.h"
+#include "top_k.h"
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Initial capacity of the record array when the whole input is read into memory
+#define INITIAL_CAPACITY 65536
+// Records read at a time from unmappable inputs before conversion to the compact layout
+#define COMPACT_CHUNK 4096
+// Leading records of the input timed by calibrate_record_cutoff()
+#define CALIBRATION_RECORDS 100000
+// Most records the key and permutation arrays can index with their 32-bit positions;
+// larger inputs are sorted as records, as when those arrays cannot be allocated
+#define MAX_INDEXED_RECORDS ((size_t)UINT32_MAX)
+
+// The element moves of sort_elem.h are specialised on the size of a Record, and the sorts
+// keep one in a stack slot
+_Static_assert(sizeof(Record) == ELEM_RECORD_SIZE, "ELEM_RECORD_SIZE must match Record");
+_Static_assert(sizeof(Record) <= ELEM_STACK_MAX, "a Record must fit in ELEM_STACK_MAX");
+
 static int selected_field = 1;
 
+// Compact elements sorted in indirect mode: the key of a record and its position
+typedef struct {
+    int key;
+    uint32_t index;
+} IntKey;
+
+typedef struct {
+    float key;
+    uint32_t index;
+} FloatKey;
+
+// Element of the field1 sorts: the abbreviated key of the string, that is its first 8
+// bytes read as a big-endian integer (padded with zeros), the string and the position
+// of its record. Most comparisons are decided by the prefix alone, without touching
+// the string.
+typedef struct {
+    uint64_t prefix;
+    const char *string;
+    uint32_t index;
+} StringKey;
+
 // Function to set the field to compare records by
 void set_compare_field(int field) {
     selected_field = field;
 }
 
-int compare_record(const void *a, const void *b) {
-    const Record *ra = (const Record *)a;
-    const Record *rb = (const Record *)b;
+// Comparators for each field, which unlike compare_record() need no global state
+static int compare_field1(const void *a, const void *b) {
+    return strcmp(((const Record *)a)->field1, ((const Record *)b)->field1);
+}
+
+static int compare_field2(const void *a, const void *b) {
+    int ka = ((const Record *)a)->field2;
+    int kb = ((const Record *)b)->field2;
+    return (ka > kb) - (ka < kb);
+}
+
+static int compare_field3(const void *a, const void *b) {
+    float ka = ((const Record *)a)->field3;
+    float kb = ((const Record *)b)->field3;
+    return (ka > kb) - (ka < kb);
+}
 
-    // Compare based on the selected field
-    switch (selected_field) {
+static int compare_none(const void *a, const void *b) {
+    (void)a;
+    (void)b;
+    return 0;
+}
+
+// Function to get the comparator of a field
+RecordCompar record_comparator(size_t field) {
+    switch (field) {
         case 1:
-            return strcmp(ra->field1, rb->field1);
+            return compare_field1;
         case 2:
-            return ra->field2 - rb->field2;
+            return compare_field2;
         case 3:
-            return (ra->field3 > rb->field3) - (ra->field3 < rb->field3);
+            return compare_field3;
         default:
-            return 0;
+            return compare_none;
     }
 }
 
-// Function to sort records from an input file and write them to an output file
-void sort_records(FILE *infile, FILE *outfile, size_t field, size_t algo) {
-    printf("Sorting by field %zu using algorithm %zu\n", field, algo);
-    // Allocate memory for records
-    Record *records = malloc(sizeof(Record) * 20000000);
-    if (!records) return;
+// Function to compare records by the field pointed to by the context
+int compare_record_r(const void *a, const void *b, void *field) {
+    return record_comparator(*(const size_t *)field)(a, b);
+}
+
+int compare_record(const void *a, const void *b) {
+    return selected_field < 0 ? 0 : record_comparator((size_t)selected_field)(a, b);
+}
+
+// Abbreviated key of a string: its first 8 bytes, the first one most significant, so
+// that comparing keys compares the prefixes like strcmp() (as unsigned chars)
+static uint64_t string_prefix(const char *string) {
+    uint64_t prefix = 0;
+    for (int i = 0; i < 8 && string[i] != '\0'; i++) {
+        prefix |= (uint64_t)(unsigned char)string[i] << (56 - 8 * i);
+    }
+    return prefix;
+}
+
+// Compare two string keys: equal prefixes mean equal first 8 bytes, so if the last of
+// them is a NUL both strings are equal, and otherwise strcmp() goes on from byte 8
+static inline int string_key_compare(const StringKey *a, const StringKey *b) {
+    if (a->prefix != b->prefix) return a->prefix < b->prefix ? -1 : 1;
+    if ((a->prefix & 0xFF) == 0) return 0;
+    return strcmp(a->string + 8, b->string + 8);
+}
+
+// Comparators for the indirect mode, consistent with compare_record
+static int compare_string_key(const void *a, const void *b) {
+    return string_key_compare((const StringKey *)a, (const StringKey *)b);
+}
+
+static int compare_int_key(const void *a, const void *b) {
+    int ka = ((const IntKey *)a)->key;
+    int kb = ((const IntKey *)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+static int compare_float_key(const void *a, const void *b) {
+    float ka = ((const FloatKey *)a)->key;
+    float kb = ((const FloatKey *)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+// Comparators for the numeric fields of compact records
+static int compare_compact_field2(const void *a, const void *b) {
+    int ka = ((const CompactRecord *)a)->field2;
+    int kb = ((const CompactRecord *)b)->field2;
+    return (ka > kb) - (ka < kb);
+}
+
+static int compare_compact_field3(const void *a, const void *b) {
+    float ka = ((const CompactRecord *)a)->field3;
+    float kb = ((const CompactRecord *)b)->field3;
+    return (ka > kb) - (ka < kb);
+}
+
+// Sort an array with the algorithm selected by algo
+static void sort_array(void *base, size_t nitems, size_t size,
+                       int (*compar)(const void *, const void *), size_t algo, size_t threads) {
+    switch (algo) {
+        case 0:
+        case 1:
+        case 4:
+            parallel_merge_sort(base, nitems, size, compar, threads);
+            break;
+        case 3:
+            tim_sort(base, nitems, size, compar);
+            break;
+        case 5:
+            inplace_merge_sort(base, nitems, size, compar);
+            break;
+        default:
+            sample_sort(base, nitems, size, compar, threads);
+            break;
+    }
+}
 
-    // Read records from the input file
+// Define inlined merge and quick sort kernels for one element type and ordering, and
+// name_sort(), which uses them for the sequential merge and quick sorts and falls back
+// to sort_array() with the equivalent comparator for tim sort, the in-place merge sort
+// and the parallel sorts
+#define DEFINE_TYPED_SORT(name, type, less_expr, compar)                     \
+    SORT_DEFINE(name, type, less_expr)                                        \
+    static void name##_sort(type *base, size_t nitems, size_t algo, size_t threads) { \
+        if (threads > 1 || algo == 3 || algo == 5)                            \
+            sort_array(base, nitems, sizeof(type), compar, algo, threads);    \
+        else if (algo == 2)                                                   \
+            name##_quick_sort(base, nitems);                                  \
+        else                                                                  \
+            name##_merge_sort(base, nitems);                                  \
+    }
+
+// One kernel per field of the records, and per kind of indirect key
+DEFINE_TYPED_SORT(record_field1, Record, strcmp(a->field1, b->field1) < 0, compare_field1)
+DEFINE_TYPED_SORT(record_field2, Record, a->field2 < b->field2, compare_field2)
+DEFINE_TYPED_SORT(record_field3, Record, a->field3 < b->field3, compare_field3)
+DEFINE_TYPED_SORT(string_key, StringKey, string_key_compare(a, b) < 0, compare_string_key)
+DEFINE_TYPED_SORT(int_key, IntKey, a->key < b->key, compare_int_key)
+DEFINE_TYPED_SORT(float_key, FloatKey, a->key < b->key, compare_float_key)
+DEFINE_TYPED_SORT(compact_field2, CompactRecord, a->field2 < b->field2, compare_compact_field2)
+DEFINE_TYPED_SORT(compact_field3, CompactRecord, a->field3 < b->field3, compare_compact_field3)
+
+// Function to read records from a CSV file
+size_t read_records(FILE *infile, Record *records, size_t capacity) {
     size_t count = 0;
-    while (fscanf(infile, "%d,%127[^,],%d,%f\n", &records[count].id, records[count].field1,
+    while (count < capacity &&
+           fscanf(infile, "%d,%127[^,],%d,%f\n", &records[count].id, records[count].field1,
                   &records[count].field2, &records[count].field3) == 4) {
         count++;
     }
+    return count;
+}
 
-    set_compare_field(field);
+// Read the whole input into an array that grows as needed. Regular files are mapped
+// and parsed in one go, with up to `threads` threads, into an array sized by their
+// line count; other inputs are read with fscanf. Returns NULL if memory runs out.
+static Record *read_all_records(FILE *infile, size_t threads, size_t *count) {
+    CsvReader reader;
+    if (csv_reader_open(&reader, infile) == 0) {
+        Record *records = csv_reader_read_all(&reader, threads, count);
+        csv_reader_close(&reader);
+        return records;
+    }
 
-    if (algo == 1)
-        merge_sort(records, count, sizeof(Record), compare_record);
-    else
-        quick_sort(records, count, sizeof(Record), compare_record);
+    size_t capacity = INITIAL_CAPACITY;
+    Record *records = malloc(sizeof(Record) * capacity);
+    if (!records) return NULL;
+
+    *count = 0;
+    for (;;) {
+        *count += read_records(infile, records + *count, capacity - *count);
+        if (*count < capacity) break;
+
+        // The array is full, but the input may go on
+        Record *grown = realloc(records, sizeof(Record) * capacity * 2);
+        if (!grown) {
+            free(records);
+            return NULL;
+        }
+        records = grown;
+        capacity *= 2;
+    }
+    return records;
+}
+
+// Write a single record in CSV format
+void write_record(FILE *outfile, const Record *record) {
+    char line[RECORD_LINE_MAX];
+    fwrite(line, 1, format_record(line, record), outfile);
+}
+
+// Sort the abbreviated field1 keys of the records with algorithm algo (or leave them in
+// input order if algo is SIZE_MAX). Returns the keys (to be freed), or NULL if memory
+// cannot be allocated or there are too many records to index.
+static StringKey *string_key_order(const Record *records, size_t count, size_t algo,
+                                   size_t threads) {
+    if (count > MAX_INDEXED_RECORDS) return NULL;
+    StringKey *keys = malloc(sizeof(StringKey) * (count > 0 ? count : 1));
+    if (!keys) return NULL;
+    for (size_t i = 0; i < count; ++i) {
+        keys[i].prefix = string_prefix(records[i].field1);
+        keys[i].string = records[i].field1;
+        keys[i].index = (uint32_t)i;
+    }
+    if (algo != SIZE_MAX) string_key_sort(keys, count, algo, threads);
+    return keys;
+}
+
+// Move the records to a sorted order: position i receives the record at order[i]. Each
+// cycle of the permutation is followed once, and order is reset on the way to mark the
+// positions already filled.
+static void permute_records(Record *records, uint32_t *order, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (order[i] == i) continue;
+        Record first = records[i];
+        size_t j = i;
+        for (;;) {
+            size_t next = order[j];
+            order[j] = (uint32_t)j;
+            if (next == i) {
+                records[j] = first;
+                break;
+            }
+            records[j] = records[next];
+            j = next;
+        }
+    }
+}
+
+// The order-preserving unsigned key of a numeric field stored at key: an int for field 2,
+// a float for field 3
+static uint32_t numeric_key(const char *key, size_t field) {
+    if (field == 2) {
+        int value;
+        memcpy(&value, key, sizeof(value));
+        return radix_key_int(value);
+    }
+    float value;
+    memcpy(&value, key, sizeof(value));
+    return radix_key_float(value);
+}
+
+// The packed (key, index) values of a numeric field, see int64_key_pair(), sorted with
+// int64_sort(). The key of record i (an int for field 2, a float for field 3) is found
+// at keys + i * size. Returns the values (to be freed), or NULL if memory cannot be
+// allocated or there are too many records to index.
+static int64_t *key_pair_order(const char *keys, size_t size, size_t count, size_t field) {
+    if (count > MAX_INDEXED_RECORDS) return NULL;
+    int64_t *values = malloc(sizeof(int64_t) * (count > 0 ? count : 1));
+    if (!values) return NULL;
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = int64_key_pair(numeric_key(keys + i * size, field), (uint32_t)i);
+    }
+    int64_sort(values, count);
+    return values;
+}
+
+// Sort compact (key, index) pairs, or abbreviated keys for the string field, and write
+// the records in the resulting order without moving them. Returns 0 on success, -1 if
+// the index array cannot be allocated or there are too many records to index.
+static int sort_indirect(const Record *records, size_t count, size_t field, size_t algo,
+                         size_t threads, CsvWriter *writer) {
+    if (count > MAX_INDEXED_RECORDS) return -1;
+    if ((field == 2 || field == 3) && algo == 2 && threads <= 1) {
+        // Sequential quick sort of a numeric field: packed (key, index) values
+        size_t offset = field == 2 ? offsetof(Record, field2) : offsetof(Record, field3);
+        int64_t *values = key_pair_order((const char *)records + offset, sizeof(Record), count,
+                                         field);
+        if (!values) return -1;
+        for (size_t i = 0; i < count; ++i) {
+            csv_writer_put(writer, &records[int64_key_index(values[i])]);
+        }
+        free(values);
+    } else if (field == 2) {
+        IntKey *keys = malloc(sizeof(IntKey) * count);
+        if (!keys) return -1;
+        for (size_t i = 0; i < count; ++i) {
+            keys[i].key = records[i].field2;
+            keys[i].index = (uint32_t)i;
+        }
+        int_key_sort(keys, count, algo, threads);
+        for (size_t i = 0; i < count; ++i) csv_writer_put(writer, &records[keys[i].index]);
+        free(keys);
+    } else if (field == 3) {
+        FloatKey *keys = malloc(sizeof(FloatKey) * count);
+        if (!keys) return -1;
+        for (size_t i = 0; i < count; ++i) {
+            keys[i].key = records[i].field3;
+            keys[i].index = (uint32_t)i;
+        }
+        float_key_sort(keys, count, algo, threads);
+        for (size_t i = 0; i < count; ++i) csv_writer_put(writer, &records[keys[i].index]);
+        free(keys);
+    } else {
+        // field1 keys are too wide to copy, so sort their abbreviated keys instead
+        StringKey *keys = string_key_order(records, count, field == 1 ? algo : SIZE_MAX, threads);
+        if (!keys) return -1;
+        for (size_t i = 0; i < count; ++i) csv_writer_put(writer, &records[keys[i].index]);
+        free(keys);
+    }
+    return 0;
+}
+
+// Radix sort the order-preserving keys of a numeric field together with the record
+// indices. The key of record i (an int for field 2, a float for field 3) is found at
+// keys + i * size. Returns the sorted pairs (to be freed), or NULL if memory cannot be
+// allocated or there are too many records to index.
+static RadixPair *radix_order(const char *keys, size_t size, size_t count, size_t field) {
+    if (count > MAX_INDEXED_RECORDS) return NULL;
+    RadixPair *pairs = malloc(sizeof(RadixPair) * count);
+    if (!pairs) return NULL;
+    for (size_t i = 0; i < count; ++i) {
+        pairs[i].key = numeric_key(keys + i * size, field);
+        pairs[i].index = (uint32_t)i;
+    }
+    if (radix_sort_pairs(pairs, count) != 0) {
+        free(pairs);
+        return NULL;
+    }
+    return pairs;
+}
+
+// Radix sort the records by a numeric field and write them in the resulting order.
+// Returns 0 on success, -1 if memory cannot be allocated.
+static int sort_radix(const Record *records, size_t count, size_t field, CsvWriter *writer) {
+    size_t offset = field == 2 ? offsetof(Record, field2) : offsetof(Record, field3);
+    RadixPair *pairs = radix_order((const char *)records + offset, sizeof(Record), count, field);
+    if (!pairs) return -1;
+    for (size_t i = 0; i < count; ++i) csv_writer_put(writer, &records[pairs[i].index]);
+    free(pairs);
+    return 0;
+}
+
+// Sort pointers to the field1 strings with multikey quicksort and write the records in
+// the resulting order. Returns 0 on success, -1 if memory cannot be allocated.
+static int sort_strings(const Record *records, size_t count, CsvWriter *writer) {
+    const char **keys = malloc(sizeof(char *) * count);
+    if (!keys) return -1;
+    for (size_t i = 0; i < count; ++i) keys[i] = records[i].field1;
+    string_sort(keys, count);
+    for (size_t i = 0; i < count; ++i) {
+        csv_writer_put(writer, (const Record *)(keys[i] - offsetof(Record, field1)));
+    }
+    free(keys);
+    return 0;
+}
+
+// Function to sort an array of records in place
+void sort_record_array(Record *records, size_t count, const SortOptions *options) {
+    size_t field = options->field;
+    uint32_t *order = NULL;
+
+    // Sort keys much smaller than the records and move every record once at the end:
+    // the abbreviated keys of field1, and the packed (key, index) values of a numeric
+    // field for the sequential quick sort. The record indices are then packed at the
+    // start of the key array, each over bytes of keys that have already been read. The
+    // in-place merge sort (algorithm 5) is chosen to avoid such arrays, so it skips them.
+    if (field == 1 && options->algo != 5) {
+        StringKey *keys = string_key_order(records, count, options->algo, options->threads);
+        order = (uint32_t *)keys;
+        for (size_t i = 0; keys && i < count; ++i) {
+            uint32_t index = keys[i].index;
+            memcpy(order + i, &index, sizeof(index));
+        }
+    } else if ((field == 2 || field == 3) && options->algo == 2 && options->threads <= 1) {
+        size_t offset = field == 2 ? offsetof(Record, field2) : offsetof(Record, field3);
+        int64_t *values = key_pair_order((const char *)records + offset, sizeof(Record), count,
+                                         field);
+        order = (uint32_t *)values;
+        for (size_t i = 0; values && i < count; ++i) {
+            uint32_t index = int64_key_index(values[i]);
+            memcpy(order + i, &index, sizeof(index));
+        }
+    }
+    if (order) {
+        permute_records(records, order, count);
+        free(order);
+        return;
+    }
+
+    // Otherwise, or if the keys cannot be allocated, sort the records themselves
+    switch (field) {
+        case 1:
+            record_field1_sort(records, count, options->algo, options->threads);
+            break;
+        case 2:
+            record_field2_sort(records, count, options->algo, options->threads);
+            break;
+        case 3:
+            record_field3_sort(records, count, options->algo, options->threads);
+            break;
+        default:
+            sort_array(records, count, sizeof(Record), record_comparator(field),
+                       options->algo, options->threads);
+            break;
+    }
+}
+
+// Sort the loaded records with the method selected by the options and write them
+static void sort_and_write(Record *records, size_t count, const SortOptions *options,
+                           CsvWriter *writer) {
+    size_t field = options->field;
+    size_t algo = options->algo;
+
+    // Automatic selection: radix sort for the numeric fields, multikey quicksort for field1
+    if (algo == 0 && (field == 2 || field == 3) && sort_radix(records, count, field, writer) == 0) {
+        return;
+    }
+    if ((algo == 0 || algo == 4) && field == 1 && sort_strings(records, count, writer) == 0) {
+        return;
+    }
+
+    // In indirect mode, and for the sequential quick sort of a numeric field, which sorts
+    // packed (key, index) values, the records are written straight from the input buffer
+    int packed = (field == 2 || field == 3) && algo == 2 && options->threads <= 1;
+    if ((options->indirect || packed) &&
+        sort_indirect(records, count, field, algo, options->threads, writer) == 0) {
+        return;
+    }
+
+    sort_record_array(records, count, options);
 
     // Write sorted records to the output file
     for (size_t i = 0; i < count; ++i) {
-        fprintf(outfile, "%d,%s,%d,%f\n", records[i].id, records[i].field1, records[i].field2, records[i].field3);
+        csv_writer_put(writer, &records[i]);
+    }
+}
+
+// Read the whole input into an array of compact records, like read_all_records().
+// Inputs that cannot be mapped are read in chunks of records that are converted.
+// Returns NULL if memory runs out.
+static CompactRecord *read_all_compact(FILE *infile, size_t threads, size_t *count,
+                                       StringArena *strings) {
+    CsvReader reader;
+    if (csv_reader_open(&reader, infile) == 0) {
+        CompactRecord *records = csv_reader_read_all_compact(&reader, threads, count, strings);
+        csv_reader_close(&reader);
+        return records;
+    }
+
+    string_arena_init(strings);
+    size_t capacity = INITIAL_CAPACITY;
+    CompactRecord *records = malloc(sizeof(CompactRecord) * capacity);
+    Record *chunk = malloc(sizeof(Record) * COMPACT_CHUNK);
+    int failed = !records || !chunk;
+
+    *count = 0;
+    size_t read = COMPACT_CHUNK;
+    while (!failed && read == COMPACT_CHUNK) {
+        read = read_records(infile, chunk, COMPACT_CHUNK);
+        if (capacity - *count < read) {
+            CompactRecord *grown = realloc(records, sizeof(CompactRecord) * capacity * 2);
+            failed = !grown;
+            if (failed) break;
+            records = grown;
+            capacity *= 2;
+        }
+        for (size_t i = 0; i < read && !failed; i++) {
+            failed = compact_record_set(&records[(*count)++], &chunk[i], strings) != 0;
+        }
+    }
+    free(chunk);
+    if (failed) {
+        free(records);
+        string_arena_free(strings);
+        return NULL;
+    }
+    return records;
+}
+
+// Sort compact records with the method selected by the options and write them. The
+// numeric fields use the same methods as sort_and_write(), field1 its abbreviated keys;
+// if they cannot be allocated, field1 is sorted with the arena as context by
+// merge_sort_r(), or quick_sort_r() for algorithm 2. The in-place merge sort (algorithm
+// 5) skips the keys and sorts the records with inplace_merge_sort_r(). The indirect mode
+// is not needed for records this small.
+static void sort_compact_and_write(CompactRecord *records, size_t count,
+                                   const StringArena *strings, const SortOptions *options,
+                                   CsvWriter *writer) {
+    size_t field = options->field;
+    size_t algo = options->algo;
+
+    if (algo == 0 && (field == 2 || field == 3)) {
+        size_t offset = field == 2 ? offsetof(CompactRecord, field2) : offsetof(CompactRecord, field3);
+        RadixPair *pairs = radix_order((const char *)records + offset, sizeof(CompactRecord),
+                                       count, field);
+        if (pairs) {
+            for (size_t i = 0; i < count; ++i) {
+                csv_writer_put_compact(writer, &records[pairs[i].index], strings);
+            }
+            free(pairs);
+            return;
+        }
+    }
+
+    // field1 is sorted by its abbreviated keys, pointing into the arena
+    int keyed = field == 1 && algo != 5 && count <= MAX_INDEXED_RECORDS;
+    StringKey *keys = keyed ? malloc(sizeof(StringKey) * (count > 0 ? count : 1)) : NULL;
+    if (keys) {
+        for (size_t i = 0; i < count; ++i) {
+            keys[i].string = compact_field1(&records[i], strings);
+            keys[i].prefix = string_prefix(keys[i].string);
+            keys[i].index = (uint32_t)i;
+        }
+        string_key_sort(keys, count, algo, options->threads);
+        for (size_t i = 0; i < count; ++i) {
+            csv_writer_put_compact(writer, &records[keys[i].index], strings);
+        }
+        free(keys);
+        return;
+    }
+
+    if (field == 2) {
+        compact_field2_sort(records, count, algo, options->threads);
+    } else if (field == 3) {
+        compact_field3_sort(records, count, algo, options->threads);
+    } else {
+        CompactOrder order = {field, strings};
+        if (algo == 2)
+            quick_sort_r(records, count, sizeof(CompactRecord), compare_compact_r, &order);
+        else if (algo == 5)
+            inplace_merge_sort_r(records, count, sizeof(CompactRecord), compare_compact_r, &order);
+        else
+            merge_sort_r(records, count, sizeof(CompactRecord), compare_compact_r, &order);
+    }
+
+    for (size_t i = 0; i < count; ++i) csv_writer_put_compact(writer, &records[i], strings);
+}
+
+// Function to sort records from an input file and write them to an output file
+void sort_records(FILE *infile, FILE *outfile, size_t field, size_t algo) {
+    SortOptions options = {.field = field, .algo = algo};
+    sort_records_with(infile, outfile, &options);
+}
+
+// Load the whole input: binary record files are mapped, CSV files parsed with up to
+// `threads` threads. binary->mapping is left NULL for a parsed input. Returns NULL on
+// failure, which is reported on stderr.
+static Record *load_records(FILE *infile, size_t threads, RecordFile *binary, size_t *count) {
+    int kind = record_file_map(binary, infile);
+    if (kind < 0) return NULL;
+    if (kind == 0) {
+        *count = binary->count;
+        return binary->records;
+    }
+
+    binary->mapping = NULL;
+    Record *records = read_all_records(infile, threads, count);
+    if (!records) {
+        fprintf(stderr, "Error: not enough memory to load the input, try --max-memory\n");
+    }
+    return records;
+}
+
+// Release the records returned by load_records()
+static void release_records(Record *records, RecordFile *binary) {
+    if (binary->mapping)
+        record_file_unmap(binary);
+    else
+        free(records);
+}
+
+// Function to sort records with the given options
+int sort_records_with(FILE *infile, FILE *outfile, const SortOptions *options) {
+    size_t field = options->field;
+    size_t algo = options->algo;
+
+    printf("Sorting by field %zu using algorithm %zu\n", field, algo);
+
+    // Only the first records are wanted: keep them in a heap while streaming the input
+    if (options->limit > 0) {
+        if (top_k_records(infile, outfile, options) != 0) {
+            fprintf(stderr, "Error: selecting the first %zu records failed\n", options->limit);
+            return -1;
+        }
+        return 0;
+    }
+
+    // With a memory budget, sort in chunks spilled to disk
+    if (options->max_memory > 0) {
+        if (external_sort_records(infile, outfile, options) != 0) {
+            fprintf(stderr, "Error: external sort failed\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // Binary record files are sorted straight from their mapping, CSV files are parsed
+    // into Records or, if asked, compact records
+    RecordFile binary;
+    int kind = record_file_map(&binary, infile);
+    if (kind < 0) return -1;
+
+    CsvWriter writer;
+    csv_writer_open(&writer, outfile);
+    size_t count;
+    int result = 0;
+    if (kind == 0) {
+        sort_and_write(binary.records, binary.count, options, &writer);
+        record_file_unmap(&binary);
+    } else if (options->compact) {
+        StringArena strings;
+        CompactRecord *records = read_all_compact(infile, options->threads, &count, &strings);
+        if (records) {
+            sort_compact_and_write(records, count, &strings, options, &writer);
+            free(records);
+        } else {
+            fprintf(stderr, "Error: not enough memory to load the input, try --max-memory\n");
+            result = -1;
+        }
+        string_arena_free(&strings);
+    } else {
+        Record *records = read_all_records(infile, options->threads, &count);
+        if (records) {
+            sort_and_write(records, count, options, &writer);
+            free(records);
+        } else {
+            fprintf(stderr, "Error: not enough memory to load the input, try --max-memory\n");
+            result = -1;
+        }
+    }
+
+    if (csv_writer_close(&writer) != 0) {
+        fprintf(stderr, "Error: failed to write the output\n");
+        result = -1;
+    }
+    return result;
+}
+
+// The sort timed by calibrate_record_cutoff()
+typedef struct {
+    const Record *sample;
+    Record *copy;
+    size_t count;
+    size_t field;
+} CutoffBench;
+
+// Sort a copy of the sample with the sequential merge sort, then with the quick sort.
+// The numeric fields call the Record kernels directly: sort_record_array() would hand
+// their quick sort to int64_sort(), which does not use the cutoff being measured.
+static void run_cutoff_bench(void *arg) {
+    CutoffBench *bench = arg;
+    for (size_t algo = 1; algo <= 2; algo++) {
+        memcpy(bench->copy, bench->sample, sizeof(Record) * bench->count);
+        if (bench->field == 2) {
+            record_field2_sort(bench->copy, bench->count, algo, 1);
+        } else if (bench->field == 3) {
+            record_field3_sort(bench->copy, bench->count, algo, 1);
+        } else {
+            SortOptions options = {.field = bench->field, .algo = algo, .threads = 1};
+            sort_record_array(bench->copy, bench->count, &options);
+        }
+    }
+}
+
+// Function to measure the insertion sort cutoff for sorting records by a field
+int calibrate_record_cutoff(FILE *infile, FILE *outfile, size_t field) {
+    CutoffBench bench = {NULL, NULL, 0, field};
+    Record *sample = malloc(sizeof(Record) * CALIBRATION_RECORDS);
+    bench.copy = malloc(sizeof(Record) * CALIBRATION_RECORDS);
+    bench.sample = sample;
+    int result = sample && bench.copy ? 0 : -1;
+
+    RecordStream stream;
+    if (result == 0 && record_stream_open(&stream, infile) != 0) result = -1;
+    if (result == 0) {
+        bench.count = record_stream_read(&stream, sample, CALIBRATION_RECORDS);
+        record_stream_close(&stream);
+
+        // Field1 is sorted through its abbreviated keys, the numeric fields as records
+        size_t size = field == 1 ? sizeof(StringKey) : sizeof(Record);
+        size_t cutoff = sort_calibrate_cutoff(size, run_cutoff_bench, &bench);
+        printf("Insertion sort cutoff for %zu-byte elements: %zu\n", size, cutoff);
+        if (sort_save_cutoffs(outfile) != 0) result = -1;
+    }
+
+    free(sample);
+    free(bench.copy);
+    return result;
+}
+
+// One ordering of the multi-field sort
+typedef struct {
+    const Record *records;
+    size_t count;
+    size_t field;
+    size_t algo;
+    size_t threads;
+    FILE *outfile;
+    int result;
+} FieldOrdering;
+
+// Sort a permutation of the shared records by one field and write the records in that
+// order, with the same methods as sort_and_write() but never moving the records
+static void write_field_ordering(void *arg) {
+    FieldOrdering *ordering = arg;
+    const Record *records = ordering->records;
+    size_t count = ordering->count;
+    size_t field = ordering->field;
+    size_t algo = ordering->algo;
+
+    CsvWriter writer;
+    csv_writer_open(&writer, ordering->outfile);
+    int result = -1;
+    if (algo == 0 && (field == 2 || field == 3)) result = sort_radix(records, count, field, &writer);
+    if ((algo == 0 || algo == 4) && field == 1) result = sort_strings(records, count, &writer);
+    if (result != 0) {
+        result = sort_indirect(records, count, field, algo, ordering->threads, &writer);
+    }
+    if (csv_writer_close(&writer) != 0) result = -1;
+    ordering->result = result;
+}
+
+// Function to sort records by several fields after a single parse
+int sort_records_multi(FILE *infile, FILE **outfiles, const size_t *fields, size_t nfields,
+                       const SortOptions *options) {
+    for (size_t i = 0; i < nfields; i++) {
+        printf("Sorting by field %zu using algorithm %zu\n", fields[i], options->algo);
+    }
+    if (nfields == 0) return 0;
+
+    RecordFile binary;
+    size_t count;
+    Record *records = load_records(infile, options->threads, &binary, &count);
+    if (!records) return -1;
+
+    // One thread per field; the threads of the options are shared among the fields
+    FieldOrdering *orderings = malloc(sizeof(FieldOrdering) * nfields);
+    ThreadPool *pool = orderings ? thread_pool_create(nfields) : NULL;
+    int result = pool ? 0 : -1;
+    if (pool) {
+        size_t threads = options->threads / nfields > 1 ? options->threads / nfields : 1;
+        for (size_t i = 0; i < nfields; i++) {
+            orderings[i] = (FieldOrdering){records, count, fields[i], options->algo, threads,
+                                           outfiles[i], 0};
+        }
+        TaskGroup group = TASK_GROUP_INIT;
+        for (size_t i = 0; i + 1 < nfields; i++) {
+            thread_pool_spawn(pool, &group, write_field_ordering, &orderings[i]);
+        }
+        write_field_ordering(&orderings[nfields - 1]);
+        thread_pool_wait(pool, &group);
+
+        for (size_t i = 0; i < nfields; i++) {
+            if (orderings[i].result != 0) {
+                fprintf(stderr, "Error: failed to sort or write the output by field %zu\n",
+                        fields[i]);
+                result = -1;
+            }
+        }
+    } else {
+        fprintf(stderr, "Error: not enough memory to sort by several fields\n");
     }
 
-    free(records);
+    thread_pool_free(pool);
+    free(orderings);
+    release_records(records, &binary);
+    return result;
 }
@@ -0,0 +1,81 @@
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "record_file.h"
+
+// Function to map a binary record file
+int record_file_map(RecordFile *file, FILE *in) {
+    struct stat info;
+    long offset = ftell(in);
+    if (offset < 0 || fstat(fileno(in), &info) != 0 || !S_ISREG(info.st_mode)) return 1;
+
+    size_t length = (size_t)info.st_size;
+    if (length < (size_t)offset + sizeof(RecordFileHeader)) return 1;
+
+    void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(in), 0);
+    if (mapping == MAP_FAILED) return 1;
+
+    RecordFileHeader header;
+    memcpy(&header, (char *)mapping + offset, sizeof(header));
+    if (memcmp(header.magic, RECORD_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        munmap(mapping, length);
+        return 1;
+    }
+
+    size_t available = (length - (size_t)offset - sizeof(header)) / sizeof(Record);
+    Record *records = (Record *)((char *)mapping + offset + sizeof(header));
+    const char *problem = NULL;
+    if (header.version != RECORD_FILE_VERSION) {
+        problem = "unsupported version";
+    } else if (header.record_size != sizeof(Record)) {
+        problem = "record size or byte order of another platform";
+    } else if (header.count > available) {
+        problem = "file shorter than its record count";
+    } else {
+        // Every field1 must be a terminated string, or the comparisons would read past
+        // the record (and past the mapping for the last one)
+        for (uint64_t i = 0; i < header.count && !problem; i++) {
+            if (records[i].field1[sizeof(records[i].field1) - 1] != '\0') {
+                problem = "field1 of a record is not terminated";
+            }
+        }
+    }
+    if (problem) {
+        fprintf(stderr, "Error: invalid binary record file: %s\n", problem);
+        munmap(mapping, length);
+        return -1;
+    }
+
+    madvise(mapping, length, MADV_WILLNEED);
+    file->records = records;
+    file->count = (size_t)header.count;
+    file->mapping = mapping;
+    file->length = length;
+    fseek(in, 0, SEEK_END);
+    return 0;
+}
+
+// Function to release a mapped record file
+void record_file_unmap(RecordFile *file) {
+    munmap(file->mapping, file->length);
+}
+
+// Function to write the header of a record file
+int record_file_write_header(FILE *out, uint64_t count) {
+    RecordFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RECORD_FILE_MAGIC, sizeof(header.magic));
+    header.version = RECORD_FILE_VERSION;
+    header.record_size = sizeof(Record);
+    header.count = count;
+    return fwrite(&header, sizeof(header), 1, out) == 1 ? 0 : -1;
+}
+
+// Function to append rows to a record file
+int record_file_append(FILE *out, Record *records, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        size_t length = strnlen(records[i].field1, sizeof(records[i].field1));
+        memset(records[i].field1 + length, 0, sizeof(records[i].field1) - length);
+    }
+    return fwrite(records, sizeof(Record), count, out) == count ? 0 : -1;
+}
@@ -0,0 +1,36 @@
+#include <string.h>
+#include "record_stream.h"
+
+// Function to start reading the records of an input
+int record_stream_open(RecordStream *stream, FILE *file) {
+    stream->file = file;
+    stream->copied = 0;
+    int kind = record_file_map(&stream->binary, file);
+    if (kind < 0) return -1;
+    if (kind == 0)
+        stream->kind = 0;
+    else
+        stream->kind = csv_reader_open(&stream->reader, file) == 0 ? 1 : 2;
+    return 0;
+}
+
+// Function to read the next records
+size_t record_stream_read(RecordStream *stream, Record *records, size_t capacity) {
+    if (stream->kind == 0) {
+        size_t left = stream->binary.count - stream->copied;
+        size_t count = left < capacity ? left : capacity;
+        memcpy(records, stream->binary.records + stream->copied, sizeof(Record) * count);
+        stream->copied += count;
+        return count;
+    }
+    if (stream->kind == 1) return csv_reader_read(&stream->reader, records, capacity);
+    return read_records(stream->file, records, capacity);
+}
+
+// Function to release the mapping of the input
+void record_stream_close(RecordStream *stream) {
+    if (stream->kind == 0)
+        record_file_unmap(&stream->binary);
+    else if (stream->kind == 1)
+        csv_reader_close(&stream->reader);
+}
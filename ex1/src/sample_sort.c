@@ -0,0 +1,257 @@
+#include <stdint.h>
+#include <string.h>
+#include "sort.h"
+#include "sort_elem.h"
+#include "thread_pool.h"
+
+// Ranges of at most this many elements are sorted with quick_sort() by a single thread
+#define SAMPLE_GRAIN 16384
+// Target number of buckets per thread, to even out the work between threads
+#define BUCKETS_PER_THREAD 4
+// Sample elements drawn per target bucket
+#define OVERSAMPLE 32
+// Maximum number of times an oversized bucket is split again
+#define MAX_RESPLIT_DEPTH 4
+
+// Parameters shared by all the tasks of one sample_sort() call
+typedef struct {
+    ThreadPool *pool;
+    size_t size;
+    int (*compar)(const void *, const void *);
+} SampleContext;
+
+// One level of sample sort over base[0 .. nitems), with scratch space of the same size.
+// Buckets are numbered 0 .. 2 * nsplitters: even buckets hold the keys strictly between
+// two splitters, odd bucket 2 * i + 1 the keys equal to splitter i.
+typedef struct {
+    const SampleContext *ctx;
+    char *base;
+    char *scratch;
+    size_t nitems;
+    size_t depth;
+    const char *splitters;
+    size_t nsplitters;
+    size_t nbuckets;
+    uint32_t *bucket_of;  // Bucket of each element, computed once by the classification
+    size_t nblocks;
+    size_t *counts;       // nblocks x nbuckets histogram, then scatter positions
+    size_t *bucket_start; // nbuckets + 1 bucket boundaries
+} SampleLevel;
+
+// Argument of the per-block and per-bucket tasks of a level
+typedef struct {
+    SampleLevel *level;
+    size_t index;
+} LevelTask;
+
+static void sample_sort_range(const SampleContext *ctx, char *base, char *scratch,
+                              size_t nitems, size_t depth);
+
+// Bucket of an element: binary search for the number of splitters <= element
+static uint32_t classify(const char *elem, const char *splitters, size_t nsplitters,
+                         size_t size, int (*compar)(const void *, const void *)) {
+    size_t low = 0, high = nsplitters;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (compar(splitters + mid * size, elem) <= 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low > 0 && compar(elem, splitters + (low - 1) * size) == 0) return (uint32_t)(2 * low - 1);
+    return (uint32_t)(2 * low);
+}
+
+// Elements [begin, end) of block number index
+static void block_range(const SampleLevel *level, size_t index, size_t *begin, size_t *end) {
+    *begin = level->nitems * index / level->nblocks;
+    *end = level->nitems * (index + 1) / level->nblocks;
+}
+
+// Task body: classify one block of the input and count its bucket sizes
+static void classify_task(void *arg) {
+    const LevelTask *task = (const LevelTask *)arg;
+    SampleLevel *level = task->level;
+    size_t size = level->ctx->size;
+    size_t *count = level->counts + task->index * level->nbuckets;
+    size_t begin, end;
+    block_range(level, task->index, &begin, &end);
+
+    for (size_t i = begin; i < end; i++) {
+        uint32_t bucket = classify(level->base + i * size, level->splitters, level->nsplitters,
+                                   size, level->ctx->compar);
+        level->bucket_of[i] = bucket;
+        count[bucket]++;
+    }
+}
+
+// Task body: move the elements of one block to their bucket in the scratch array
+static void scatter_task(void *arg) {
+    const LevelTask *task = (const LevelTask *)arg;
+    SampleLevel *level = task->level;
+    size_t size = level->ctx->size;
+    size_t *position = level->counts + task->index * level->nbuckets;
+    size_t begin, end;
+    block_range(level, task->index, &begin, &end);
+
+    for (size_t i = begin; i < end; i++) {
+        elem_copy(level->scratch + position[level->bucket_of[i]]++ * size, level->base + i * size,
+                  size);
+    }
+}
+
+// Task body: sort one bucket in the scratch array and copy it back in place
+static void bucket_task(void *arg) {
+    const LevelTask *task = (const LevelTask *)arg;
+    SampleLevel *level = task->level;
+    size_t size = level->ctx->size;
+    size_t begin = level->bucket_start[task->index];
+    size_t count = level->bucket_start[task->index + 1] - begin;
+    char *bucket = level->scratch + begin * size;
+
+    // Equality buckets (odd) are sorted already
+    if (task->index % 2 == 0) {
+        // A bucket much bigger than expected (skewed keys) is split again
+        size_t expected = level->nitems / (level->nsplitters + 1);
+        if (count > 2 * expected && count > SAMPLE_GRAIN && level->depth < MAX_RESPLIT_DEPTH) {
+            sample_sort_range(level->ctx, bucket, level->base + begin * size, count,
+                              level->depth + 1);
+        } else {
+            quick_sort(bucket, count, size, level->ctx->compar);
+        }
+    }
+    memcpy(level->base + begin * size, bucket, size * count);
+}
+
+// Run func(level, i) for i in [0, ntasks) on the pool and wait for all of them
+static void run_level_tasks(SampleLevel *level, size_t ntasks, void (*func)(void *),
+                            LevelTask *tasks) {
+    TaskGroup group = TASK_GROUP_INIT;
+    for (size_t i = 0; i < ntasks; i++) {
+        tasks[i].level = level;
+        tasks[i].index = i;
+        if (i + 1 < ntasks) thread_pool_spawn(level->ctx->pool, &group, func, &tasks[i]);
+    }
+    func(&tasks[ntasks - 1]);
+    thread_pool_wait(level->ctx->pool, &group);
+}
+
+// Pick up to ntarget - 1 distinct splitters from a sorted random sample of the range.
+// Returns the number of splitters written to splitters.
+static size_t choose_splitters(const SampleContext *ctx, const char *base, size_t nitems,
+                               size_t ntarget, char *splitters) {
+    size_t size = ctx->size;
+    size_t nsample = ntarget * OVERSAMPLE;
+    if (nsample > nitems) nsample = nitems;
+    char *sample = malloc(size * nsample);
+    if (!sample) return 0;
+
+    // Deterministic xorshift generator, so that runs are reproducible
+    uint64_t state = 0x9E3779B97F4A7C15ULL ^ nitems;
+    for (size_t i = 0; i < nsample; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        elem_copy(sample + i * size, base + (state % nitems) * size, size);
+    }
+    quick_sort(sample, nsample, size, ctx->compar);
+
+    size_t nsplitters = 0;
+    for (size_t i = 1; i < ntarget; i++) {
+        const char *candidate = sample + (i * nsample / ntarget) * size;
+        if (nsplitters > 0 &&
+            ctx->compar(splitters + (nsplitters - 1) * size, candidate) == 0) continue;
+        elem_copy(splitters + nsplitters++ * size, candidate, size);
+    }
+    free(sample);
+    return nsplitters;
+}
+
+// Sort base[0 .. nitems) by sample sort, using scratch as a buffer of the same size
+static void sample_sort_range(const SampleContext *ctx, char *base, char *scratch,
+                              size_t nitems, size_t depth) {
+    size_t size = ctx->size;
+    size_t nthreads = thread_pool_size(ctx->pool);
+    size_t ntarget = BUCKETS_PER_THREAD * nthreads;
+
+    if (nitems <= SAMPLE_GRAIN) {
+        quick_sort(base, nitems, size, ctx->compar);
+        return;
+    }
+
+    SampleLevel level;
+    level.ctx = ctx;
+    level.base = base;
+    level.scratch = scratch;
+    level.nitems = nitems;
+    level.depth = depth;
+    level.nblocks = nthreads;
+
+    char *splitters = malloc(size * ntarget);
+    level.nsplitters = splitters ? choose_splitters(ctx, base, nitems, ntarget, splitters) : 0;
+    level.splitters = splitters;
+    level.nbuckets = 2 * level.nsplitters + 1;
+    level.bucket_of = malloc(sizeof(uint32_t) * nitems);
+    level.counts = calloc(level.nblocks * level.nbuckets, sizeof(size_t));
+    level.bucket_start = malloc(sizeof(size_t) * (level.nbuckets + 1));
+    LevelTask *tasks = malloc(sizeof(LevelTask) * (level.nbuckets > level.nblocks ?
+                                                   level.nbuckets : level.nblocks));
+
+    // No usable splitters (e.g. the sample is all equal keys) or no memory
+    if (level.nsplitters == 0 || !level.bucket_of || !level.counts || !level.bucket_start ||
+        !tasks) {
+        quick_sort(base, nitems, size, ctx->compar);
+    } else {
+        // Each block is classified by one thread in a single pass
+        run_level_tasks(&level, level.nblocks, classify_task, tasks);
+
+        // Bucket boundaries, and where each block starts writing in each bucket
+        size_t offset = 0;
+        for (size_t b = 0; b < level.nbuckets; b++) {
+            level.bucket_start[b] = offset;
+            for (size_t k = 0; k < level.nblocks; k++) {
+                size_t c = level.counts[k * level.nbuckets + b];
+                level.counts[k * level.nbuckets + b] = offset;
+                offset += c;
+            }
+        }
+        level.bucket_start[level.nbuckets] = offset;
+
+        // Scatter into contiguous buckets, then sort the buckets independently
+        run_level_tasks(&level, level.nblocks, scatter_task, tasks);
+        run_level_tasks(&level, level.nbuckets, bucket_task, tasks);
+    }
+
+    free(tasks);
+    free(level.bucket_start);
+    free(level.counts);
+    free(level.bucket_of);
+    free(splitters);
+}
+
+// Parallel sample sort function
+void sample_sort(void *base, size_t nitems, size_t size,
+                 int (*compar)(const void *, const void *), size_t nthreads) {
+    // Base case: if the array has 0 or 1 item, or invalid parameters
+    if (nitems < 2 || base == NULL || size == 0 || compar == NULL) return;
+
+    // Not worth starting threads: use the sequential sort
+    if (nthreads <= 1 || nitems <= SAMPLE_GRAIN) {
+        quick_sort(base, nitems, size, compar);
+        return;
+    }
+
+    char *scratch = malloc(size * nitems);
+    ThreadPool *pool = scratch ? thread_pool_create(nthreads) : NULL;
+    if (!pool) {
+        free(scratch);
+        quick_sort(base, nitems, size, compar);
+        return;
+    }
+
+    SampleContext ctx = {pool, size, compar};
+    sample_sort_range(&ctx, (char *)base, scratch, nitems, 0);
+
+    thread_pool_free(pool);
+    free(scratch);
+}
@@ -0,0 +1,98 @@
+#include <time.h>
+#include "sort_cutoff.h"
+
+// Element sizes whose cutoff can be set
+#define CUTOFF_SLOTS 16
+// Runs of the benchmark per candidate cutoff
+#define CALIBRATION_RUNS 3
+
+// Cutoffs timed by sort_calibrate_cutoff()
+static const size_t candidates[] = {1, 4, 6, 8, 12, 16, 24, 32, 48, 64};
+
+// Cutoffs that were set, by element size
+static struct {
+    size_t size;
+    size_t cutoff;
+} slots[CUTOFF_SLOTS];
+static size_t nslots = 0;
+
+// Function to get the cutoff used for elements of a given size
+size_t sort_cutoff(size_t size) {
+    for (size_t i = 0; i < nslots; i++) {
+        if (slots[i].size == size) return slots[i].cutoff;
+    }
+    // Built-in guess: larger elements cost more to shift by insertion, but the passes of
+    // the merge sort that the blocks replace move every element too
+    return size <= 16 ? 32 : 24;
+}
+
+// Function to set the cutoff used for elements of a given size
+int sort_set_cutoff(size_t size, size_t cutoff) {
+    if (cutoff > SORT_CUTOFF_MAX) return -1;
+    if (cutoff == 0) cutoff = 1;
+    for (size_t i = 0; i < nslots; i++) {
+        if (slots[i].size == size) {
+            slots[i].cutoff = cutoff;
+            return 0;
+        }
+    }
+    if (nslots == CUTOFF_SLOTS) return -1;
+    slots[nslots].size = size;
+    slots[nslots].cutoff = cutoff;
+    nslots++;
+    return 0;
+}
+
+// Function to forget every cutoff that was set
+void sort_reset_cutoffs(void) {
+    nslots = 0;
+}
+
+// Seconds elapsed since an unspecified point
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Function to measure the best cutoff for an element size and comparison function
+size_t sort_calibrate_cutoff(size_t size, void (*bench)(void *ctx), void *ctx) {
+    size_t best = sort_cutoff(size);
+    double best_time = 0.0;
+
+    for (size_t c = 0; c < sizeof(candidates) / sizeof(candidates[0]); c++) {
+        sort_set_cutoff(size, candidates[c]);
+        double fastest = 0.0;
+        for (int run = 0; run < CALIBRATION_RUNS; run++) {
+            double start = now();
+            bench(ctx);
+            double elapsed = now() - start;
+            if (run == 0 || elapsed < fastest) fastest = elapsed;
+        }
+        if (c == 0 || fastest < best_time) {
+            best = candidates[c];
+            best_time = fastest;
+        }
+    }
+
+    sort_set_cutoff(size, best);
+    return best;
+}
+
+// Function to write the cutoffs that were set
+int sort_save_cutoffs(FILE *file) {
+    for (size_t i = 0; i < nslots; i++) {
+        fprintf(file, "%zu,%zu\n", slots[i].size, slots[i].cutoff);
+    }
+    return ferror(file) ? -1 : 0;
+}
+
+// Function to set the cutoffs read from a file
+int sort_load_cutoffs(FILE *file) {
+    size_t size, cutoff;
+    int matched;
+    while ((matched = fscanf(file, "%zu,%zu", &size, &cutoff)) == 2) {
+        if (sort_set_cutoff(size, cutoff) != 0) return -1;
+    }
+    return matched == EOF && !ferror(file) ? 0 : -1;
+}
@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include "sort.h"
+
+// Groups of at most this many strings are finished with insertion sort
+#define INSERTION_CUTOFF 16
+
+// Character of s at position depth, as compared by strcmp
+#define CHAR_AT(s, depth) ((unsigned char)(s)[depth])
+
+// Function to swap two string pointers
+static void swap_strings(const char **a, const char **b) {
+    const char *temp = *a;
+    *a = *b;
+    *b = temp;
+}
+
+// Order for equal strings: by address, so pointers into a single array keep their order
+static int compare_address(const void *a, const void *b) {
+    uintptr_t pa = (uintptr_t)*(const char *const *)a;
+    uintptr_t pb = (uintptr_t)*(const char *const *)b;
+    return (pa > pb) - (pa < pb);
+}
+
+// Insertion sort of strings that are known to share their first depth characters
+static void insertion_sort(const char **strings, size_t nitems, size_t depth) {
+    for (size_t i = 1; i < nitems; i++) {
+        for (size_t j = i; j > 0; j--) {
+            int cmp = strcmp(strings[j - 1] + depth, strings[j] + depth);
+            if (cmp < 0 || (cmp == 0 && strings[j - 1] < strings[j])) break;
+            swap_strings(&strings[j - 1], &strings[j]);
+        }
+    }
+}
+
+// Return the median of three characters
+static int median_char(int a, int b, int c) {
+    if (a < b) {
+        if (b < c) return b;
+        return a < c ? c : a;
+    }
+    if (a < c) return a;
+    return b < c ? c : b;
+}
+
+// Multikey quicksort: partition on the character at position depth into <, = and >
+// groups. The < and > groups are sorted recursively at the same depth, while the =
+// group moves on to the next character in the loop.
+static void multikey_sort(const char **strings, size_t nitems, size_t depth) {
+    while (nitems > INSERTION_CUTOFF) {
+        int pivot = median_char(CHAR_AT(strings[0], depth), CHAR_AT(strings[nitems / 2], depth),
+                                CHAR_AT(strings[nitems - 1], depth));
+
+        // [0, lt) < pivot, [lt, i) == pivot, [i, gt) unknown, [gt, nitems) > pivot
+        size_t lt = 0, i = 0, gt = nitems;
+        while (i < gt) {
+            int c = CHAR_AT(strings[i], depth);
+            if (c < pivot)
+                swap_strings(&strings[lt++], &strings[i++]);
+            else if (c > pivot)
+                swap_strings(&strings[i], &strings[--gt]);
+            else
+                i++;
+        }
+
+        multikey_sort(strings, lt, depth);
+        multikey_sort(strings + gt, nitems - gt, depth);
+
+        strings += lt;
+        nitems = gt - lt;
+        if (pivot == '\0') {
+            // All the strings in the middle group have ended: they are equal
+            quick_sort(strings, nitems, sizeof(const char *), compare_address);
+            return;
+        }
+        depth++;
+    }
+    insertion_sort(strings, nitems, depth);
+}
+
+// Sort string pointers with multikey quicksort
+void string_sort(const char **strings, size_t nitems) {
+    // Base case: if the array has 0 or 1 item, or invalid parameters
+    if (nitems < 2 || strings == NULL) return;
+    multikey_sort(strings, nitems, 0);
+}
@@ -1,6 +1,14 @@
 #include "../lib/unity/unity.h"
 #include "record.h"
+#include "compact_record.h"
+#include "csv_reader.h"
+#include "csv_writer.h"
+#include "quantiles.h"
+#include "record_file.h"
 #include "sort.h"
+#include "sort_cutoff.h"
+#include "sort_template.h"
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -219,6 +227,1208 @@ void test_sorting_stability(void) {
     TEST_ASSERT_EQUAL_INT(3, records[2].id);
 }
 
+// Test quick_sort on a large already sorted array (worst case for a fixed pivot)
+void test_quick_sort_large_presorted(void) {
+    size_t n = 100000;
+    int *arr = malloc(n * sizeof(int));
+    TEST_ASSERT_NOT_NULL(arr);
+    for (size_t i = 0; i < n; i++) arr[i] = (int)i;
+
+    quick_sort(arr, n, sizeof(int), compare_int);
+
+    for (size_t i = 0; i < n; i++) {
+        TEST_ASSERT_EQUAL_INT((int)i, arr[i]);
+    }
+    free(arr);
+}
+
+// Test quick_sort on a large array of equal keys
+void test_quick_sort_large_all_equal(void) {
+    size_t n = 50000;
+    int *arr = malloc(n * sizeof(int));
+    TEST_ASSERT_NOT_NULL(arr);
+    for (size_t i = 0; i < n; i++) arr[i] = 7;
+
+    quick_sort(arr, n, sizeof(int), compare_int);
+
+    for (size_t i = 0; i < n; i++) {
+        TEST_ASSERT_EQUAL_INT(7, arr[i]);
+    }
+    free(arr);
+}
+
+// Test quick_sort on records with only a few distinct keys
+void test_quick_sort_few_distinct_keys(void) {
+    size_t n = 3000;
+    Record *records = malloc(n * sizeof(Record));
+    TEST_ASSERT_NOT_NULL(records);
+    for (size_t i = 0; i < n; i++) {
+        records[i].id = (int)i;
+        strcpy(records[i].field1, (i * 7) % 3 == 0 ? "red" : ((i * 7) % 3 == 1 ? "green" : "blue"));
+        records[i].field2 = (int)(i % 4);
+        records[i].field3 = 0.5f;
+    }
+
+    set_compare_field(1);
+    quick_sort(records, n, sizeof(Record), compare_record);
+    for (size_t i = 1; i < n; i++) {
+        TEST_ASSERT_TRUE(compare_record(&records[i - 1], &records[i]) <= 0);
+    }
+    TEST_ASSERT_EQUAL_STRING("blue", records[0].field1);
+    TEST_ASSERT_EQUAL_STRING("red", records[n - 1].field1);
+
+    set_compare_field(2);
+    quick_sort(records, n, sizeof(Record), compare_record);
+    for (size_t i = 1; i < n; i++) {
+        TEST_ASSERT_TRUE(records[i - 1].field2 <= records[i].field2);
+    }
+    free(records);
+}
+
+// Test merge_sort stability on a large array with odd length and few keys
+void test_merge_sort_large_stability(void) {
+    size_t n = 10007;
+    Record *records = malloc(n * sizeof(Record));
+    TEST_ASSERT_NOT_NULL(records);
+    for (size_t i = 0; i < n; i++) {
+        records[i].id = (int)i;
+        strcpy(records[i].field1, "x");
+        records[i].field2 = (int)((i * 31) % 5);
+        records[i].field3 = 0.0f;
+    }
+
+    set_compare_field(2);
+    merge_sort(records, n, sizeof(Record), compare_record);
+
+    for (size_t i = 1; i < n; i++) {
+        TEST_ASSERT_TRUE(records[i - 1].field2 <= records[i].field2);
+        if (records[i - 1].field2 == records[i].field2) {
+            TEST_ASSERT_TRUE(records[i - 1].id < records[i].id);
+        }
+    }
+    free(records);
+}
+
+// Test tim_sort with integer array
+void test_tim_sort_integers(void) {
+    int arr[] = {64, 34, 25, 12, 22, 11, 90};
+    int expected[] = {11, 12, 22, 25, 34, 64, 90};
+    size_t n = sizeof(arr) / sizeof(arr[0]);
+
+    tim_sort(arr, n, sizeof(int), compare_int);
+
+    for (size_t i = 0; i < n; i++) {
+        TEST_ASSERT_EQUAL_INT(expected[i], arr[i]);
+    }
+}
+
+// Test tim_sort on ascending and descending runs with duplicates, checking stability
+void test_tim_sort_runs_stability(void) {
+    size_t n = 5000;
+    Record *records = malloc(n * sizeof(Record));
+    TEST_ASSERT_NOT_NULL(records);
+    for (size_t i = 0; i < n; i++) {
+        records[i].id = (int)i;
+        strcpy(records[i].field1, "run");
+        // Alternating ascending and descending stretches, each key repeated twice
+        size_t block = i / 700;
+        int key = (int)((i % 700) / 2);
+        records[i].field2 = (block % 2 == 0) ? key : 350 - key;
+        records[i].field3 = 0.0f;
+    }
+
+    set_compare_field(2);
+    tim_sort(records, n, sizeof(Record), compare_record);
+
+    for (size_t i = 1; i < n; i++) {
+        TEST_ASSERT_TRUE(records[i - 1].field2 <= records[i].field2);
+        if (records[i - 1].field2 == records[i].field2) {
+            TEST_ASSERT_TRUE(records[i - 1].id < records[i].id);
+        }
+    }
+    free(records);
+}
+
+// Test radix_sort_pairs on signed and float keys, checking order and stability
+void test_radix_sort_pairs_keys(void) {
+    int ints[] = {5, -3, 2147483647, 0, -2147483647 - 1, -3, 7, 0};
+    float floats[] = {1.5f, -0.0f, -2.25f, 0.0f, 1e30f, -1e-30f, 1.5f, -7.0f};
+    size_t n = sizeof(ints) / sizeof(ints[0]);
+    RadixPair pairs[8];
+
+    for (size_t i = 0; i < n; i++) {
+        pairs[i].key = radix_key_int(ints[i]);
+        pairs[i].index = (uint32_t)i;
+    }
+    TEST_ASSERT_EQUAL_INT(0, radix_sort_pairs(pairs, n));
+    for (size_t i = 1; i < n; i++) {
+        int prev = ints[pairs[i - 1].index], cur = ints[pairs[i].index];
+        TEST_ASSERT_TRUE(prev <= cur);
+        if (prev == cur) TEST_ASSERT_TRUE(pairs[i - 1].index < pairs[i].index);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        pairs[i].key = radix_key_float(floats[i]);
+        pairs[i].index = (uint32_t)i;
+    }
+    TEST_ASSERT_EQUAL_INT(0, radix_sort_pairs(pairs, n));
+    for (size_t i = 1; i < n; i++) {
+        float prev = floats[pairs[i - 1].index], cur = floats[pairs[i].index];
+        TEST_ASSERT_TRUE(prev <= cur);
+        if (prev == cur) TEST_ASSERT_TRUE(pairs[i - 1].index < pairs[i].index);
+    }
+}
+
+static int compare_int64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Test int64_sort with and without the AVX2 kernels on every size up to a few sorting
+// networks, and on large arrays of random, presorted, reversed and few distinct values
+void test_int64_sort_matches_merge_sort(void) {
+    size_t n = 5000;
+    int64_t *expected = malloc(sizeof(int64_t) * n);
+    int64_t *actual = malloc(sizeof(int64_t) * n);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+    srand(31);
+    for (int avx2 = 0; avx2 <= 1; avx2++) {
+        int64_sort_set_avx2(avx2);
+        for (size_t t = 0; t < 200 + 5 * 4; t++) {
+            size_t count = t < 200 ? t : n;
+            int pattern = t < 200 ? 0 : (int)(t - 200) % 5;
+            for (size_t i = 0; i < count; i++) {
+                int64_t value = ((int64_t)rand() << 32) ^ rand();
+                if (rand() % 2) value = -value;
+                if (rand() % 40 == 0) value = rand() % 2 ? INT64_MAX : INT64_MIN;
+                if (pattern == 1) value = (int64_t)i;
+                if (pattern == 2) value = -(int64_t)i;
+                if (pattern >= 3) value = rand() % (pattern == 3 ? 3 : 1);
+                expected[i] = actual[i] = value;
+            }
+            merge_sort(expected, count, sizeof(int64_t), compare_int64);
+            int64_sort(actual, count);
+            TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(int64_t) * count);
+        }
+    }
+    int64_sort_set_avx2(1);
+    free(expected);
+    free(actual);
+}
+
+// Test that the packed (key, index) values sort like a stable sort of the keys
+void test_int64_key_pair_order(void) {
+    int keys[] = {5, -3, 2147483647, 0, -2147483647 - 1, -3, 7, 0};
+    size_t n = sizeof(keys) / sizeof(keys[0]);
+    int64_t values[8];
+    for (size_t i = 0; i < n; i++) values[i] = int64_key_pair(radix_key_int(keys[i]), (uint32_t)i);
+    int64_sort(values, n);
+    uint32_t expected[] = {4, 1, 5, 3, 7, 0, 6, 2};
+    for (size_t i = 0; i < n; i++) {
+        TEST_ASSERT_EQUAL_INT(expected[i], int64_key_index(values[i]));
+    }
+}
+
+// Test that parallel_merge_sort gives exactly the same result as merge_sort
+void test_parallel_merge_sort_matches_merge_sort(void) {
+    size_t n = 100000;
+    Record *expected = malloc(n * sizeof(Record));
+    Record *actual = malloc(n * sizeof(Record));
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+    memset(expected, 0, n * sizeof(Record));
+    srand(42);
+    for (size_t i = 0; i < n; i++) {
+        expected[i].id = (int)i;
+        snprintf(expected[i].field1, sizeof(expected[i].field1), "k%d", rand() % 1000);
+        expected[i].field2 = rand() % 5000;
+        expected[i].field3 = (float)(rand() % 100) / 4.0f;
+    }
+    memcpy(actual, expected, n * sizeof(Record));
+
+    set_compare_field(2);
+    merge_sort(expected, n, sizeof(Record), compare_record);
+    parallel_merge_sort(actual, n, sizeof(Record), compare_record, 4);
+
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, n * sizeof(Record));
+    free(expected);
+    free(actual);
+}
+
+// Test that inplace_merge_sort, its _r variant and algorithm 5 give exactly the same
+// result as merge_sort, on runs both shorter and much longer than the sqrt(n) buffer
+void test_inplace_merge_sort_matches_merge_sort(void) {
+    size_t n = 20000;
+    Record *input = malloc(n * sizeof(Record));
+    Record *expected = malloc(n * sizeof(Record));
+    Record *actual = malloc(n * sizeof(Record));
+    TEST_ASSERT_NOT_NULL(input);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+    memset(input, 0, n * sizeof(Record));
+    srand(47);
+    for (int pattern = 0; pattern < 3; pattern++) {
+        // Few distinct keys, so that stability shows; random, ascending or descending
+        for (size_t i = 0; i < n; i++) {
+            input[i].id = (int)i;
+            snprintf(input[i].field1, sizeof(input[i].field1), "k%d", rand() % 50);
+            input[i].field2 = pattern == 0 ? rand() % 300 : (int)(pattern == 1 ? i : n - i) / 7;
+            input[i].field3 = (float)(rand() % 30) / 4.0f;
+        }
+        // Without insertion sort, every merge pass runs too
+        for (size_t cutoff = 0; cutoff <= 1; cutoff++) {
+            if (cutoff) TEST_ASSERT_EQUAL_INT(0, sort_set_cutoff(sizeof(Record), cutoff));
+            for (size_t count = 0; count <= n; count = count < 200 ? count + 37 : count * 10) {
+                memcpy(expected, input, count * sizeof(Record));
+                memcpy(actual, input, count * sizeof(Record));
+                set_compare_field(2);
+                merge_sort(expected, count, sizeof(Record), compare_record);
+                inplace_merge_sort(actual, count, sizeof(Record), compare_record);
+                TEST_ASSERT_EQUAL_MEMORY(expected, actual, count * sizeof(Record));
+            }
+            sort_reset_cutoffs();
+        }
+    }
+
+    size_t field = 1;
+    memcpy(expected, input, n * sizeof(Record));
+    memcpy(actual, input, n * sizeof(Record));
+    merge_sort_r(expected, n, sizeof(Record), compare_record_r, &field);
+    inplace_merge_sort_r(actual, n, sizeof(Record), compare_record_r, &field);
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, n * sizeof(Record));
+
+    for (field = 1; field <= 3; field++) {
+        SortOptions merge = {.field = field, .algo = 1};
+        SortOptions inplace = {.field = field, .algo = 5};
+        memcpy(expected, input, n * sizeof(Record));
+        memcpy(actual, input, n * sizeof(Record));
+        sort_record_array(expected, n, &merge);
+        sort_record_array(actual, n, &inplace);
+        TEST_ASSERT_EQUAL_MEMORY(expected, actual, n * sizeof(Record));
+    }
+    free(input);
+    free(expected);
+    free(actual);
+}
+
+// Test sample_sort on uniform and heavily skewed keys
+void test_sample_sort_skewed_keys(void) {
+    size_t n = 200000;
+    int *arr = malloc(n * sizeof(int));
+    long long *histogram = calloc(1000, sizeof(long long));
+    TEST_ASSERT_NOT_NULL(arr);
+    TEST_ASSERT_NOT_NULL(histogram);
+    srand(7);
+    for (size_t i = 0; i < n; i++) {
+        // Half of the keys are 500, the others spread over [0, 1000)
+        arr[i] = (i % 2 == 0) ? 500 : rand() % 1000;
+        histogram[arr[i]]++;
+    }
+
+    sample_sort(arr, n, sizeof(int), compare_int, 4);
+
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0) TEST_ASSERT_TRUE(arr[i - 1] <= arr[i]);
+        histogram[arr[i]]--;
+    }
+    for (size_t k = 0; k < 1000; k++) {
+        TEST_ASSERT_EQUAL_INT(0, histogram[k]);
+    }
+    free(arr);
+    free(histogram);
+}
+
+// Test string_sort on strings with long shared prefixes and duplicates
+void test_string_sort_prefixes(void) {
+    const char *words[] = {"prefix_b", "prefix_a", "pre", "", "prefix_a", "prefix", "zeta",
+                           "prefix_ab", "Prefix", "pre", "alpha", "prefix_b", "\xc3\xa0", "a",
+                           "prefix_aa", "prefix_", "b", "prefix_a", "pr", "zz"};
+    size_t n = sizeof(words) / sizeof(words[0]);
+    const char *sorted[sizeof(words) / sizeof(words[0])];
+    memcpy(sorted, words, sizeof(words));
+
+    string_sort(sorted, n);
+
+    for (size_t i = 1; i < n; i++) {
+        int cmp = strcmp(sorted[i - 1], sorted[i]);
+        TEST_ASSERT_TRUE(cmp <= 0);
+        // Equal strings are in address order
+        if (cmp == 0) TEST_ASSERT_TRUE(sorted[i - 1] <= sorted[i]);
+    }
+    TEST_ASSERT_EQUAL_STRING("", sorted[0]);
+    TEST_ASSERT_EQUAL_STRING("\xc3\xa0", sorted[n - 1]);
+}
+
+// Sample input used by the sort_records tests
+static const char *sample_csv =
+    "1,pear,30,2.5\n"
+    "2,apple,-10,0.25\n"
+    "3,fig,30,-1.5\n"
+    "4,apple,2147483647,7\n"
+    "5,kiwi,-2147483647,0.25\n"
+    "6,banana,0,100.125\n"
+    "7,plum,-10,-0.0\n"
+    "8,lime,0,0.0\n";
+
+// Run sort_records_with on the given CSV text and return the output (to be freed)
+static char *sort_csv(const char *csv, const SortOptions *options) {
+    FILE *in = tmpfile();
+    FILE *out = tmpfile();
+    TEST_ASSERT_NOT_NULL(in);
+    TEST_ASSERT_NOT_NULL(out);
+    fputs(csv, in);
+    rewind(in);
+
+    TEST_ASSERT_EQUAL_INT(0, sort_records_with(in, out, options));
+
+    long length = ftell(out);
+    char *result = malloc((size_t)length + 1);
+    TEST_ASSERT_NOT_NULL(result);
+    rewind(out);
+    size_t read = fread(result, 1, (size_t)length, out);
+    result[read] = '\0';
+    fclose(in);
+    fclose(out);
+    return result;
+}
+
+// Test that the indirect mode writes the same output as the direct stable sort
+void test_sort_records_indirect_matches_direct(void) {
+    for (size_t field = 1; field <= 3; field++) {
+        SortOptions direct = {.field = field, .algo = 1};
+        SortOptions indirect = {.field = field, .algo = 1, .indirect = 1};
+        char *expected = sort_csv(sample_csv, &direct);
+        char *actual = sort_csv(sample_csv, &indirect);
+        TEST_ASSERT_EQUAL_STRING(expected, actual);
+        free(expected);
+        free(actual);
+    }
+}
+
+// Test the indirect mode output by field2, including keys whose difference overflows int
+void test_sort_records_indirect_field2(void) {
+    SortOptions options = {.field = 2, .algo = 3, .indirect = 1};
+    char *actual = sort_csv(sample_csv, &options);
+    TEST_ASSERT_EQUAL_STRING(
+        "5,kiwi,-2147483647,0.250000\n"
+        "2,apple,-10,0.250000\n"
+        "7,plum,-10,-0.000000\n"
+        "6,banana,0,100.125000\n"
+        "8,lime,0,0.000000\n"
+        "1,pear,30,2.500000\n"
+        "3,fig,30,-1.500000\n"
+        "4,apple,2147483647,7.000000\n", actual);
+    free(actual);
+}
+
+// Test that automatic selection (radix sort on numeric fields) matches the stable merge sort
+void test_sort_records_auto_matches_merge(void) {
+    for (size_t field = 1; field <= 3; field++) {
+        SortOptions merge = {.field = field, .algo = 1};
+        SortOptions automatic = {.field = field, .algo = 0};
+        char *expected = sort_csv(sample_csv, &merge);
+        char *actual = sort_csv(sample_csv, &automatic);
+        TEST_ASSERT_EQUAL_STRING(expected, actual);
+        free(expected);
+        free(actual);
+    }
+}
+
+// Test that the sequential quick sort of a numeric field, which sorts packed (key, index)
+// values, keeps equal keys in input order like the merge sort
+void test_sort_records_numeric_quick_matches_merge(void) {
+    size_t n = 3000;
+    Record *expected = malloc(sizeof(Record) * n);
+    Record *actual = malloc(sizeof(Record) * n);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+    srand(37);
+    for (size_t i = 0; i < n; i++) {
+        expected[i].id = (int)i;
+        snprintf(expected[i].field1, sizeof(expected[i].field1), "r%zu", i);
+        expected[i].field2 = rand() % 50 - 25;
+        expected[i].field3 = (float)(rand() % 40) / 4.0f - 5.0f;
+    }
+    for (size_t field = 2; field <= 3; field++) {
+        SortOptions merge = {.field = field, .algo = 1};
+        SortOptions quick = {.field = field, .algo = 2};
+        memcpy(actual, expected, sizeof(Record) * n);
+        sort_record_array(expected, n, &merge);
+        sort_record_array(actual, n, &quick);
+        TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(Record) * n);
+
+        char *merged = sort_csv(sample_csv, &merge);
+        char *quicked = sort_csv(sample_csv, &quick);
+        TEST_ASSERT_EQUAL_STRING(merged, quicked);
+        free(merged);
+        free(quicked);
+    }
+    free(expected);
+    free(actual);
+}
+
+// Test that the multikey string sort writes the same output as the stable merge sort
+void test_sort_records_string_matches_merge(void) {
+    SortOptions merge = {.field = 1, .algo = 1};
+    SortOptions strings = {.field = 1, .algo = 4};
+    char *expected = sort_csv(sample_csv, &merge);
+    char *actual = sort_csv(sample_csv, &strings);
+    TEST_ASSERT_EQUAL_STRING(expected, actual);
+    free(expected);
+    free(actual);
+}
+
+// Test that the external sort with a tiny memory budget matches the in-memory sort
+void test_sort_records_external_matches_memory(void) {
+    size_t n = 5000;
+    char *csv = malloc(n * 64);
+    TEST_ASSERT_NOT_NULL(csv);
+    size_t length = 0;
+    srand(11);
+    for (size_t i = 0; i < n; i++) {
+        length += (size_t)sprintf(csv + length, "%zu,name%d,%d,%d.5\n", i, rand() % 300,
+                                  rand() % 100, rand() % 50);
+    }
+
+    for (size_t field = 1; field <= 3; field++) {
+        SortOptions memory = {.field = field, .algo = 1};
+        // The smallest budget still sorts chunks of about a thousand records
+        SortOptions external = {.field = field, .algo = 1, .max_memory = 1};
+        char *expected = sort_csv(csv, &memory);
+        char *actual = sort_csv(csv, &external);
+        TEST_ASSERT_EQUAL_STRING(expected, actual);
+        free(expected);
+        free(actual);
+    }
+
+    // A run directory that cannot be written is reported as a failure
+    SortOptions missing = {.field = 2, .algo = 1, .max_memory = 1, .tmp_dir = "/nonexistent/ex1"};
+    FILE *in = tmpfile();
+    FILE *out = tmpfile();
+    TEST_ASSERT_NOT_NULL(in);
+    TEST_ASSERT_NOT_NULL(out);
+    fputs(csv, in);
+    rewind(in);
+    TEST_ASSERT_EQUAL_INT(-1, sort_records_with(in, out, &missing));
+    fclose(in);
+    fclose(out);
+    free(csv);
+}
+
+// Test the CSV line parser on valid and malformed lines
+void test_parse_record_line_valid_and_malformed(void) {
+    const char *valid[] = {"12,pear,-30,2.5", " 7,two words, 41, -0.125\r", "-2147483648,x,2147483647,1e3"};
+    Record expected[] = {{12, "pear", -30, 2.5f}, {7, "two words", 41, -0.125f},
+                         {-2147483647 - 1, "x", 2147483647, 1000.0f}};
+    for (size_t i = 0; i < 3; i++) {
+        Record record;
+        TEST_ASSERT_EQUAL_INT(0, parse_record_line(valid[i], valid[i] + strlen(valid[i]), &record));
+        TEST_ASSERT_EQUAL_INT(expected[i].id, record.id);
+        TEST_ASSERT_EQUAL_STRING(expected[i].field1, record.field1);
+        TEST_ASSERT_EQUAL_INT(expected[i].field2, record.field2);
+        TEST_ASSERT_EQUAL_FLOAT(expected[i].field3, record.field3);
+    }
+
+    char long_name[160];
+    memset(long_name, 'a', sizeof(long_name));
+    sprintf(long_name + 128, ",1,2.0");
+    const char *malformed[] = {"", "1,pear,3", "1,,3,4.0", "x,pear,3,4.0", "1,pear,3,4.0junk",
+                               "2147483648,pear,3,4.0", "1,pear,3,abc", long_name};
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        Record record;
+        const char *line = malformed[i];
+        TEST_ASSERT_EQUAL_INT(-1, parse_record_line(line, line + strlen(line), &record));
+    }
+}
+
+// Test that the fast float path rounds exactly like strtof
+void test_parse_record_line_float_matches_strtof(void) {
+    srand(5);
+    for (int i = 0; i < 20000; i++) {
+        static const int scales[] = {10, 100, 1000, 10000, 100000, 1000000};
+        int digits = 1 + i % 6;
+        char line[64];
+        int length = sprintf(line, "1,a,2,%d.%0*d", rand() % 200000 - 100000, digits,
+                             rand() % scales[digits - 1]);
+        Record record;
+        TEST_ASSERT_EQUAL_INT(0, parse_record_line(line, line + length, &record));
+        float expected = strtof(line + 6, NULL);
+        TEST_ASSERT_EQUAL_MEMORY(&expected, &record.field3, sizeof(float));
+    }
+}
+
+// Test that a malformed line is skipped instead of ending the input
+void test_sort_records_skips_malformed_line(void) {
+    SortOptions options = {.field = 2, .algo = 1};
+    char *actual = sort_csv("1,pear,30,2.5\n2,broken\n\n3,fig,-4,1.0\n", &options);
+    TEST_ASSERT_EQUAL_STRING("3,fig,-4,1.000000\n1,pear,30,2.500000\n", actual);
+    free(actual);
+}
+
+// Test that parsing with several threads gives the same records, in the same order
+void test_csv_reader_read_all_threads(void) {
+    FILE *file = tmpfile();
+    TEST_ASSERT_NOT_NULL(file);
+    srand(13);
+    for (int i = 0; i < 60000; i++) {
+        if (i % 9973 == 0) fputs("malformed line\n\n", file);
+        fprintf(file, "%d,name%d,%d,%d.25\n", i, rand() % 1000, rand() % 100, rand() % 50);
+    }
+
+    Record *expected = NULL;
+    for (size_t threads = 1; threads <= 4; threads++) {
+        CsvReader reader;
+        rewind(file);
+        TEST_ASSERT_EQUAL_INT(0, csv_reader_open(&reader, file));
+        size_t count;
+        Record *records = csv_reader_read_all(&reader, threads, &count);
+        TEST_ASSERT_NOT_NULL(records);
+        TEST_ASSERT_EQUAL_size_t(60000, count);
+        TEST_ASSERT_EQUAL_size_t(7, reader.malformed);
+        csv_reader_close(&reader);
+
+        if (!expected) {
+            expected = records;
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                TEST_ASSERT_EQUAL_INT(expected[i].id, records[i].id);
+                TEST_ASSERT_EQUAL_STRING(expected[i].field1, records[i].field1);
+                TEST_ASSERT_EQUAL_INT(expected[i].field2, records[i].field2);
+                TEST_ASSERT_EQUAL_FLOAT(expected[i].field3, records[i].field3);
+            }
+            free(records);
+        }
+    }
+    free(expected);
+    fclose(file);
+}
+
+// Test that compact records hold the same values as Records, whatever the threads
+void test_csv_reader_read_all_compact_matches_records(void) {
+    FILE *file = tmpfile();
+    TEST_ASSERT_NOT_NULL(file);
+    srand(41);
+    for (int i = 0; i < 60000; i++) {
+        if (i % 7919 == 0) fputs("bad,line\n \n", file);
+        fprintf(file, "%d,%.*s%d,%d,%d.5\n", i, rand() % 40, "abcdefghijklmnopqrstuvwxyzabcdefghijklmn",
+                rand() % 1000, rand() % 100, rand() % 50);
+    }
+
+    CsvReader reader;
+    rewind(file);
+    TEST_ASSERT_EQUAL_INT(0, csv_reader_open(&reader, file));
+    size_t expected_count;
+    Record *expected = csv_reader_read_all(&reader, 1, &expected_count);
+    TEST_ASSERT_NOT_NULL(expected);
+    csv_reader_close(&reader);
+
+    for (size_t threads = 1; threads <= 4; threads += 3) {
+        rewind(file);
+        TEST_ASSERT_EQUAL_INT(0, csv_reader_open(&reader, file));
+        size_t count;
+        StringArena strings;
+        CompactRecord *records = csv_reader_read_all_compact(&reader, threads, &count, &strings);
+        TEST_ASSERT_NOT_NULL(records);
+        TEST_ASSERT_EQUAL_size_t(expected_count, count);
+        TEST_ASSERT_EQUAL_size_t(8, reader.malformed);
+        csv_reader_close(&reader);
+
+        for (size_t i = 0; i < count; i++) {
+            TEST_ASSERT_EQUAL_INT(expected[i].id, records[i].id);
+            TEST_ASSERT_EQUAL_STRING(expected[i].field1, compact_field1(&records[i], &strings));
+            TEST_ASSERT_EQUAL_size_t(strlen(expected[i].field1), records[i].field1_length);
+            TEST_ASSERT_EQUAL_INT(expected[i].field2, records[i].field2);
+            TEST_ASSERT_EQUAL_FLOAT(expected[i].field3, records[i].field3);
+
+            // The writer gives the same line for both layouts
+            char line[RECORD_LINE_MAX], compact_line[RECORD_LINE_MAX];
+            size_t length = format_record(line, &expected[i]);
+            TEST_ASSERT_EQUAL_size_t(length, format_compact_record(compact_line, &records[i], &strings));
+            TEST_ASSERT_EQUAL_MEMORY(line, compact_line, length);
+        }
+        free(records);
+        string_arena_free(&strings);
+    }
+    free(expected);
+    fclose(file);
+}
+
+// Test that format_record writes the same bytes as fprintf with "%d,%s,%d,%f\n"
+void test_format_record_matches_printf(void) {
+    float special[] = {0.0f, -0.0f, 0.0000005f, 0.0000015f, -0.0000025f, 1e-45f, 123456.789f,
+                       16777216.0f, 3.4e38f, -3.4e38f};
+    srand(17);
+    for (int i = 0; i < 20000; i++) {
+        Record record = {rand() - RAND_MAX / 2, "name", rand() - RAND_MAX / 2, 0.0f};
+        if (i < (int)(sizeof(special) / sizeof(special[0]))) {
+            record.field3 = special[i];
+        } else if (i % 2) {
+            record.field3 = (float)(rand() % 2000001 - 1000000) / 1000.0f;
+        } else {
+            uint32_t bits = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+            memcpy(&record.field3, &bits, sizeof(float));
+            if (record.field3 != record.field3) continue;
+        }
+        if (i == 1) record.id = -2147483647 - 1;
+
+        char expected[RECORD_LINE_MAX], actual[RECORD_LINE_MAX + 1];
+        snprintf(expected, sizeof(expected), "%d,%s,%d,%f\n", record.id, record.field1,
+                 record.field2, record.field3);
+        size_t length = format_record(actual, &record);
+        actual[length] = '\0';
+        TEST_ASSERT_EQUAL_STRING(expected, actual);
+    }
+}
+
+// Read the whole content of a file (to be freed)
+static char *read_file(FILE *file) {
+    long length = ftell(file);
+    char *result = malloc((size_t)length + 1);
+    TEST_ASSERT_NOT_NULL(result);
+    rewind(file);
+    size_t read = fread(result, 1, (size_t)length, file);
+    result[read] = '\0';
+    return result;
+}
+
+// Test that a binary record file sorts to the same output as the CSV it was made from
+void test_sort_records_binary_matches_csv(void) {
+    Record records[16];
+    size_t count = 0;
+    const char *line = sample_csv;
+    while (*line) {
+        const char *end = strchr(line, '\n');
+        TEST_ASSERT_EQUAL_INT(0, parse_record_line(line, end, &records[count++]));
+        line = end + 1;
+    }
+
+    FILE *binary = tmpfile();
+    TEST_ASSERT_NOT_NULL(binary);
+    TEST_ASSERT_EQUAL_INT(0, record_file_write_header(binary, count));
+    TEST_ASSERT_EQUAL_INT(0, record_file_append(binary, records, count));
+
+    for (size_t field = 1; field <= 3; field++) {
+        for (size_t algo = 0; algo <= 2; algo++) {
+            SortOptions options = {.field = field, .algo = algo};
+            FILE *out = tmpfile();
+            TEST_ASSERT_NOT_NULL(out);
+            rewind(binary);
+            TEST_ASSERT_EQUAL_INT(0, sort_records_with(binary, out, &options));
+            char *actual = read_file(out);
+            char *expected = sort_csv(sample_csv, &options);
+            TEST_ASSERT_EQUAL_STRING(expected, actual);
+            free(expected);
+            free(actual);
+            fclose(out);
+        }
+    }
+
+    // A header announcing more records than the file holds is rejected
+    rewind(binary);
+    TEST_ASSERT_EQUAL_INT(0, record_file_write_header(binary, count + 1));
+    rewind(binary);
+    RecordFile file;
+    TEST_ASSERT_EQUAL_INT(-1, record_file_map(&file, binary));
+    rewind(binary);
+    SortOptions options = {.field = 2, .algo = 1};
+    FILE *out = tmpfile();
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL_INT(-1, sort_records_with(binary, out, &options));
+    fclose(out);
+    fclose(binary);
+
+    // So is a row whose field1 has no terminating NUL
+    binary = tmpfile();
+    TEST_ASSERT_NOT_NULL(binary);
+    Record unterminated = {1, "", 2, 3.0f};
+    memset(unterminated.field1, 'x', sizeof(unterminated.field1));
+    TEST_ASSERT_EQUAL_INT(0, record_file_write_header(binary, 1));
+    TEST_ASSERT_EQUAL_INT(1, (int)fwrite(&unterminated, sizeof(Record), 1, binary));
+    fflush(binary);
+    rewind(binary);
+    TEST_ASSERT_EQUAL_INT(-1, record_file_map(&file, binary));
+    fclose(binary);
+}
+
+// Test that one multi-field sort writes the same files as one sort per field
+void test_sort_records_multi_matches_single(void) {
+    size_t fields[] = {3, 1, 2};
+    for (size_t algo = 0; algo <= 3; algo += 3) {
+        SortOptions options = {.algo = algo, .threads = 2};
+        FILE *in = tmpfile();
+        TEST_ASSERT_NOT_NULL(in);
+        fputs(sample_csv, in);
+        rewind(in);
+        FILE *outs[3];
+        for (size_t i = 0; i < 3; i++) {
+            outs[i] = tmpfile();
+            TEST_ASSERT_NOT_NULL(outs[i]);
+        }
+        TEST_ASSERT_EQUAL_INT(0, sort_records_multi(in, outs, fields, 3, &options));
+
+        for (size_t i = 0; i < 3; i++) {
+            fseek(outs[i], 0, SEEK_END);
+            char *actual = read_file(outs[i]);
+            options.field = fields[i];
+            char *expected = sort_csv(sample_csv, &options);
+            TEST_ASSERT_EQUAL_STRING(expected, actual);
+            free(expected);
+            free(actual);
+            fclose(outs[i]);
+        }
+        fclose(in);
+    }
+}
+
+// Test that sorting in the compact layout gives the same output
+void test_sort_records_compact_matches_records(void) {
+    for (size_t field = 1; field <= 3; field++) {
+        for (size_t algo = 0; algo <= 3; algo++) {
+            SortOptions options = {.field = field, .algo = algo};
+            char *expected = sort_csv(sample_csv, &options);
+            options.compact = 1;
+            char *actual = sort_csv(sample_csv, &options);
+            // Quick sort is not stable: only the keys have to be in the same order
+            if (algo != 2) TEST_ASSERT_EQUAL_STRING(expected, actual);
+            TEST_ASSERT_EQUAL_size_t(strlen(expected), strlen(actual));
+            free(expected);
+            free(actual);
+        }
+    }
+}
+
+// Test that --limit writes the first lines of the stable sort, ties included
+void test_sort_records_limit_matches_prefix(void) {
+    size_t n = 5000;
+    char *csv = malloc(n * 64);
+    TEST_ASSERT_NOT_NULL(csv);
+    size_t length = 0;
+    srand(47);
+    for (size_t i = 0; i < n; i++) {
+        length += (size_t)sprintf(csv + length, "%zu,k%d,%d,%d.5\n", i, rand() % 50,
+                                  rand() % 50, rand() % 50);
+    }
+
+    size_t limits[] = {1, 7, 300, n, n + 10};
+    for (size_t field = 1; field <= 3; field++) {
+        SortOptions options = {.field = field, .algo = 1};
+        char *sorted = sort_csv(csv, &options);
+        for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); l++) {
+            options.limit = limits[l];
+            char *actual = sort_csv(csv, &options);
+
+            // Cut the full output after `limit` lines
+            char *end = sorted;
+            for (size_t line = 0; line < limits[l] && *end; line++) end = strchr(end, '\n') + 1;
+            TEST_ASSERT_EQUAL_size_t((size_t)(end - sorted), strlen(actual));
+            TEST_ASSERT_EQUAL_MEMORY(sorted, actual, strlen(actual));
+            free(actual);
+        }
+        free(sorted);
+    }
+    free(csv);
+}
+
+// Element of the typed kernel tests: a key with few distinct values and its position
+typedef struct {
+    int key;
+    int position;
+} KeyedInt;
+
+static int compare_keyed_int(const void *a, const void *b) {
+    int ka = ((const KeyedInt *)a)->key;
+    int kb = ((const KeyedInt *)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+SORT_DEFINE(keyed_int, KeyedInt, a->key < b->key)
+
+// Fill an array of KeyedInt with random keys in [0, distinct)
+static void fill_keyed_ints(KeyedInt *items, size_t n, int distinct) {
+    for (size_t i = 0; i < n; i++) {
+        items[i].key = rand() % distinct;
+        items[i].position = (int)i;
+    }
+}
+
+// Test that the generated merge sort is stable and matches merge_sort
+void test_sort_template_merge_sort_matches_merge_sort(void) {
+    size_t sizes[] = {0, 1, 2, 3, 17, 1000, 4099};
+    srand(19);
+    for (size_t t = 0; t < sizeof(sizes) / sizeof(sizes[0]); t++) {
+        size_t n = sizes[t];
+        KeyedInt *expected = malloc(sizeof(KeyedInt) * (n + 1));
+        KeyedInt *actual = malloc(sizeof(KeyedInt) * (n + 1));
+        TEST_ASSERT_NOT_NULL(expected);
+        TEST_ASSERT_NOT_NULL(actual);
+        fill_keyed_ints(expected, n, 50);
+        memcpy(actual, expected, sizeof(KeyedInt) * n);
+
+        merge_sort(expected, n, sizeof(KeyedInt), compare_keyed_int);
+        keyed_int_merge_sort(actual, n);
+        TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(KeyedInt) * n);
+        free(expected);
+        free(actual);
+    }
+}
+
+// Test the generated quick sort on random, presorted, reversed and all-equal keys
+void test_sort_template_quick_sort_orders(void) {
+    size_t n = 20000;
+    KeyedInt *items = malloc(sizeof(KeyedInt) * n);
+    char *seen = calloc(n, 1);
+    TEST_ASSERT_NOT_NULL(items);
+    TEST_ASSERT_NOT_NULL(seen);
+    srand(23);
+    for (int pattern = 0; pattern < 4; pattern++) {
+        fill_keyed_ints(items, n, pattern == 3 ? 1 : 100);
+        if (pattern == 1 || pattern == 2) {
+            for (size_t i = 0; i < n; i++) items[i].key = pattern == 1 ? (int)i : (int)(n - i);
+        }
+
+        keyed_int_quick_sort(items, n);
+        memset(seen, 0, n);
+        for (size_t i = 0; i < n; i++) {
+            if (i > 0) TEST_ASSERT_TRUE(items[i - 1].key <= items[i].key);
+            TEST_ASSERT_FALSE(seen[items[i].position]);
+            seen[items[i].position] = 1;
+        }
+    }
+    free(seen);
+    free(items);
+}
+
+// Test that the generic and generated sorts give the same results whatever the
+// insertion sort cutoff, including none and one larger than the array
+void test_sort_cutoffs_keep_order(void) {
+    size_t n = 3000, cutoffs[] = {1, 5, 64, SORT_CUTOFF_MAX};
+    KeyedInt *input = malloc(sizeof(KeyedInt) * n);
+    KeyedInt *expected = malloc(sizeof(KeyedInt) * n);
+    KeyedInt *actual = malloc(sizeof(KeyedInt) * n);
+    TEST_ASSERT_NOT_NULL(input);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+    srand(29);
+    fill_keyed_ints(input, n, 40);
+
+    // Stable reference: the keys, with the positions in increasing order within each
+    for (size_t i = 0, k = 0; k < 40; k++) {
+        for (size_t j = 0; j < n; j++) {
+            if (input[j].key == (int)k) expected[i++] = input[j];
+        }
+    }
+
+    for (size_t c = 0; c < sizeof(cutoffs) / sizeof(cutoffs[0]); c++) {
+        TEST_ASSERT_EQUAL_INT(0, sort_set_cutoff(sizeof(KeyedInt), cutoffs[c]));
+        TEST_ASSERT_EQUAL_size_t(cutoffs[c], sort_cutoff(sizeof(KeyedInt)));
+        for (size_t m = 0; m < 4; m++) {
+            size_t count = m == 3 ? 150 : n;
+            memcpy(actual, input, sizeof(KeyedInt) * count);
+            if (m == 0) merge_sort(actual, count, sizeof(KeyedInt), compare_keyed_int);
+            if (m == 1) keyed_int_merge_sort(actual, count);
+            if (m == 2) quick_sort(actual, count, sizeof(KeyedInt), compare_keyed_int);
+            if (m == 3) keyed_int_quick_sort(actual, count);
+            for (size_t i = 0; i < count; i++) {
+                if (m < 2) {
+                    TEST_ASSERT_EQUAL_MEMORY(&expected[i], &actual[i], sizeof(KeyedInt));
+                } else if (i > 0) {
+                    TEST_ASSERT_TRUE(actual[i - 1].key <= actual[i].key);
+                }
+            }
+        }
+    }
+    sort_reset_cutoffs();
+    free(input);
+    free(expected);
+    free(actual);
+}
+
+// Benchmark of the calibration test: counts its runs
+static void count_bench_runs(void *runs) {
+    (*(int *)runs)++;
+}
+
+// Test that calibrated cutoffs are set, saved and loaded back
+void test_sort_cutoffs_calibrate_save_load(void) {
+    int runs = 0;
+    size_t cutoff = sort_calibrate_cutoff(12, count_bench_runs, &runs);
+    TEST_ASSERT_TRUE(runs > 1);
+    TEST_ASSERT_TRUE(cutoff >= 1 && cutoff <= SORT_CUTOFF_MAX);
+    TEST_ASSERT_EQUAL_size_t(cutoff, sort_cutoff(12));
+    TEST_ASSERT_EQUAL_INT(0, sort_set_cutoff(sizeof(Record), 7));
+    TEST_ASSERT_EQUAL_INT(-1, sort_set_cutoff(4, SORT_CUTOFF_MAX + 1));
+
+    FILE *file = tmpfile();
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_INT(0, sort_save_cutoffs(file));
+    sort_reset_cutoffs();
+    TEST_ASSERT_TRUE(sort_cutoff(sizeof(Record)) != 7);
+    rewind(file);
+    TEST_ASSERT_EQUAL_INT(0, sort_load_cutoffs(file));
+    TEST_ASSERT_EQUAL_size_t(cutoff, sort_cutoff(12));
+    TEST_ASSERT_EQUAL_size_t(7, sort_cutoff(sizeof(Record)));
+    fclose(file);
+
+    // A malformed table is rejected
+    file = tmpfile();
+    TEST_ASSERT_NOT_NULL(file);
+    fputs("140,9\nsixteen\n", file);
+    rewind(file);
+    TEST_ASSERT_EQUAL_INT(-1, sort_load_cutoffs(file));
+    fclose(file);
+    sort_reset_cutoffs();
+}
+
+// Largest element size of the element-size tests, not a multiple of 8
+// Test that the generated multi-select puts every wanted rank in its sorted position
+// and partitions the array around it
+void test_sort_template_multi_select(void) {
+    size_t sizes[] = {1, 2, 50, 700, 20000};
+    int distinct[] = {3, 1000000};
+    srand(53);
+    for (size_t t = 0; t < sizeof(sizes) / sizeof(sizes[0]); t++) {
+        for (size_t d = 0; d < 2; d++) {
+            size_t n = sizes[t];
+            KeyedInt *items = malloc(sizeof(KeyedInt) * n);
+            KeyedInt *sorted = malloc(sizeof(KeyedInt) * n);
+            TEST_ASSERT_NOT_NULL(items);
+            TEST_ASSERT_NOT_NULL(sorted);
+            fill_keyed_ints(items, n, distinct[d]);
+            memcpy(sorted, items, sizeof(KeyedInt) * n);
+            merge_sort(sorted, n, sizeof(KeyedInt), compare_keyed_int);
+
+            size_t ranks[] = {0, n / 2, n / 2, n * 9 / 10, n * 99 / 100, n - 1};
+            keyed_int_multi_select(items, n, ranks, sizeof(ranks) / sizeof(ranks[0]));
+            for (size_t r = 0; r < sizeof(ranks) / sizeof(ranks[0]); r++) {
+                size_t k = ranks[r];
+                TEST_ASSERT_EQUAL_INT(sorted[k].key, items[k].key);
+                for (size_t i = 0; i < k; i++) TEST_ASSERT_TRUE(items[i].key <= items[k].key);
+                for (size_t i = k + 1; i < n; i++) TEST_ASSERT_TRUE(items[i].key >= items[k].key);
+            }
+            free(items);
+            free(sorted);
+        }
+    }
+}
+
+// Test the nearest-rank quantiles of a file
+void test_record_quantiles(void) {
+    FILE *file = tmpfile();
+    TEST_ASSERT_NOT_NULL(file);
+    // field2 runs from 100 down to 1, field3 from 0.5 to 50 in steps of 0.5
+    for (int i = 0; i < 100; i++) {
+        fprintf(file, "%d,name,%d,%d.%d\n", i, 100 - i, (i + 1) / 2, (i + 1) % 2 * 5);
+    }
+    double probabilities[] = {0.999, 0.5, 0.0, 0.9, 1.0, 0.01};
+    double expected2[] = {100, 50, 1, 90, 100, 1};
+    double expected3[] = {50.0, 25.0, 0.5, 45.0, 50.0, 0.5};
+    double values[6];
+
+    rewind(file);
+    TEST_ASSERT_EQUAL_INT(0, record_quantiles(file, 2, probabilities, 6, values));
+    for (size_t i = 0; i < 6; i++) TEST_ASSERT_EQUAL_FLOAT((float)expected2[i], (float)values[i]);
+    rewind(file);
+    TEST_ASSERT_EQUAL_INT(0, record_quantiles(file, 3, probabilities, 6, values));
+    for (size_t i = 0; i < 6; i++) TEST_ASSERT_EQUAL_FLOAT((float)expected3[i], (float)values[i]);
+    fclose(file);
+
+    // No record, no quantile
+    file = tmpfile();
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_INT(1, record_quantiles(file, 2, probabilities, 6, values));
+    fclose(file);
+}
+
+#define MAX_ELEM_SIZE 100
+
+// Compare elements by the int stored in their first bytes
+static int compare_leading_int(const void *a, const void *b) {
+    int ka, kb;
+    memcpy(&ka, a, sizeof(int));
+    memcpy(&kb, b, sizeof(int));
+    return (ka > kb) - (ka < kb);
+}
+
+// Test the generic sorts on element sizes that take each move and swap path
+void test_generic_sorts_element_sizes(void) {
+    size_t sizes[] = {4, 8, 12, 16, 24, sizeof(Record), MAX_ELEM_SIZE};
+    void (*sorts[])(void *, size_t, size_t, int (*)(const void *, const void *)) = {
+        merge_sort, quick_sort, tim_sort};
+    size_t n = 3000;
+    srand(29);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t size = sizes[s];
+        char *items = malloc(size * n);
+        TEST_ASSERT_NOT_NULL(items);
+        for (size_t f = 0; f < sizeof(sorts) / sizeof(sorts[0]); f++) {
+            // The filler repeats the key, so a torn move or swap shows up as a mismatch
+            for (size_t i = 0; i < n; i++) {
+                int key = rand() % 500;
+                memset(items + i * size, key & 0xFF, size);
+                memcpy(items + i * size, &key, sizeof(int));
+            }
+            sorts[f](items, n, size, compare_leading_int);
+            for (size_t i = 0; i < n; i++) {
+                int key;
+                memcpy(&key, items + i * size, sizeof(int));
+                if (i > 0) {
+                    TEST_ASSERT_TRUE(compare_leading_int(items + (i - 1) * size, items + i * size) <= 0);
+                }
+                for (size_t b = sizeof(int); b < size; b++) {
+                    TEST_ASSERT_EQUAL_INT(key & 0xFF, (unsigned char)items[i * size + b]);
+                }
+            }
+        }
+        free(items);
+    }
+}
+
+// Compare ints in the direction given by the context (1 ascending, -1 descending)
+static int compare_int_direction(const void *a, const void *b, void *direction) {
+    int ka = *(const int *)a, kb = *(const int *)b;
+    return *(const int *)direction * ((ka > kb) - (ka < kb));
+}
+
+// Test that the _r sorts pass their context to the comparator
+void test_sort_r_with_context(void) {
+    size_t n = 2000;
+    int *items = malloc(sizeof(int) * n);
+    TEST_ASSERT_NOT_NULL(items);
+    void (*sorts[])(void *, size_t, size_t, int (*)(const void *, const void *, void *),
+                    void *) = {merge_sort_r, quick_sort_r};
+    int directions[] = {1, -1};
+    srand(31);
+    for (size_t f = 0; f < 2; f++) {
+        for (size_t d = 0; d < 2; d++) {
+            for (size_t i = 0; i < n; i++) items[i] = rand() % 300 - 150;
+            sorts[f](items, n, sizeof(int), compare_int_direction, &directions[d]);
+            for (size_t i = 1; i < n; i++) {
+                TEST_ASSERT_TRUE(directions[d] * items[i - 1] <= directions[d] * items[i]);
+            }
+        }
+    }
+    free(items);
+
+    // compare_record_r() orders like compare_record(), and merge_sort_r() stays stable
+    Record records[200], expected[200];
+    for (size_t i = 0; i < 200; i++) {
+        records[i].id = (int)i;
+        snprintf(records[i].field1, sizeof(records[i].field1), "k%d", rand() % 20);
+        records[i].field2 = rand() % 20;
+        records[i].field3 = (float)(rand() % 20) / 4.0f;
+    }
+    for (size_t field = 1; field <= 3; field++) {
+        memcpy(expected, records, sizeof(records));
+        set_compare_field((int)field);
+        merge_sort(expected, 200, sizeof(Record), compare_record);
+        Record sorted[200];
+        memcpy(sorted, records, sizeof(records));
+        merge_sort_r(sorted, 200, sizeof(Record), compare_record_r, &field);
+        for (size_t i = 0; i < 200; i++) TEST_ASSERT_EQUAL_INT(expected[i].id, sorted[i].id);
+    }
+}
+
+// Test field1 sorts on strings whose abbreviated keys tie or differ only in bytes
+// above 127, against merge_sort() with compare_record()
+void test_sort_record_array_field1_prefix_ties(void) {
+    const char *strings[] = {"abcdefgh", "abcdefg", "abcdefghi", "abcdefgh\x80", "abcdefgi",
+                             "\xc3\xa0", "a", "\x7f", "\xff", "prefix_common_1", "prefix_common_",
+                             "prefix_common_10", "prefix_c", "abcdefgh"};
+    size_t nstrings = sizeof(strings) / sizeof(strings[0]);
+    size_t n = 3000;
+    Record *input = malloc(sizeof(Record) * n);
+    Record *expected = malloc(sizeof(Record) * n);
+    Record *actual = malloc(sizeof(Record) * n);
+    TEST_ASSERT_NOT_NULL(input);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+    srand(43);
+    for (size_t i = 0; i < n; i++) {
+        // Garbage after the terminator must not reach the keys
+        memset(input[i].field1, 'z', sizeof(input[i].field1));
+        strcpy(input[i].field1, strings[rand() % nstrings]);
+        input[i].id = (int)i;
+        input[i].field2 = 0;
+        input[i].field3 = 0.0f;
+    }
+    memcpy(expected, input, sizeof(Record) * n);
+    set_compare_field(1);
+    merge_sort(expected, n, sizeof(Record), compare_record);
+
+    for (size_t algo = 1; algo <= 3; algo++) {
+        for (size_t threads = 1; threads <= 2; threads++) {
+            memcpy(actual, input, sizeof(Record) * n);
+            SortOptions options = {.field = 1, .algo = algo, .threads = threads};
+            sort_record_array(actual, n, &options);
+            for (size_t i = 0; i < n; i++) {
+                TEST_ASSERT_EQUAL_STRING(expected[i].field1, actual[i].field1);
+                if (algo != 2) TEST_ASSERT_EQUAL_INT(expected[i].id, actual[i].id);
+            }
+        }
+    }
+    free(input);
+    free(expected);
+    free(actual);
+}
+
+// One sort_record_array() call of the concurrency test
+typedef struct {
+    Record *records;
+    size_t count;
+    SortOptions options;
+} ArraySortJob;
+
+static void *run_array_sort(void *arg) {
+    ArraySortJob *job = arg;
+    sort_record_array(job->records, job->count, &job->options);
+    return NULL;
+}
+
+// Test that sorts by different fields can run at the same time
+void test_sort_record_array_concurrent_fields(void) {
+    size_t n = 20000;
+    Record *input = malloc(sizeof(Record) * n);
+    TEST_ASSERT_NOT_NULL(input);
+    srand(37);
+    for (size_t i = 0; i < n; i++) {
+        input[i].id = (int)i;
+        snprintf(input[i].field1, sizeof(input[i].field1), "key%d", rand() % 1000);
+        input[i].field2 = rand() % 1000;
+        input[i].field3 = (float)(rand() % 1000) / 8.0f;
+    }
+
+    // Three rounds of the three fields at once, each compared with a sort on its own
+    ArraySortJob jobs[9];
+    pthread_t threads[9];
+    for (size_t j = 0; j < 9; j++) {
+        jobs[j].records = malloc(sizeof(Record) * n);
+        TEST_ASSERT_NOT_NULL(jobs[j].records);
+        memcpy(jobs[j].records, input, sizeof(Record) * n);
+        jobs[j].count = n;
+        jobs[j].options = (SortOptions){.field = j % 3 + 1, .algo = j / 3 + 1, .threads = 1};
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[j], NULL, run_array_sort, &jobs[j]));
+    }
+    Record *expected = malloc(sizeof(Record) * n);
+    TEST_ASSERT_NOT_NULL(expected);
+    for (size_t j = 0; j < 9; j++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_join(threads[j], NULL));
+        RecordCompar compar = record_comparator(jobs[j].options.field);
+        memcpy(expected, input, sizeof(Record) * n);
+        sort_record_array(expected, n, &jobs[j].options);
+        for (size_t i = 0; i < n; i++) {
+            TEST_ASSERT_EQUAL_INT(0, compar(&expected[i], &jobs[j].records[i]));
+            // Merge and tim sort are stable, so the ids match too
+            if (jobs[j].options.algo != 2) {
+                TEST_ASSERT_EQUAL_INT(expected[i].id, jobs[j].records[i].id);
+            }
+        }
+        free(jobs[j].records);
+    }
+    free(expected);
+    free(input);
+}
+
 int main(void) {
     UNITY_BEGIN();
     
@@ -233,13 +1443,70 @@ int main(void) {
     RUN_TEST(test_merge_sort_single_element);
     RUN_TEST(test_merge_sort_integers);
     RUN_TEST(test_merge_sort_records);
+    RUN_TEST(test_merge_sort_large_stability);
     
     // Tests for quick_sort algorithm
     RUN_TEST(test_quick_sort_empty_array);
     RUN_TEST(test_quick_sort_single_element);
     RUN_TEST(test_quick_sort_integers);
     RUN_TEST(test_quick_sort_records);
+    RUN_TEST(test_quick_sort_large_presorted);
+    RUN_TEST(test_quick_sort_large_all_equal);
+    RUN_TEST(test_quick_sort_few_distinct_keys);
     
+    // Tests for tim_sort algorithm
+    RUN_TEST(test_tim_sort_integers);
+    RUN_TEST(test_tim_sort_runs_stability);
+    RUN_TEST(test_generic_sorts_element_sizes);
+    RUN_TEST(test_sort_r_with_context);
+
+    // Tests for the typed sort kernels
+    RUN_TEST(test_sort_template_merge_sort_matches_merge_sort);
+    RUN_TEST(test_sort_template_quick_sort_orders);
+    RUN_TEST(test_sort_template_multi_select);
+
+    // Tests for the insertion sort cutoffs
+    RUN_TEST(test_sort_cutoffs_keep_order);
+    RUN_TEST(test_sort_cutoffs_calibrate_save_load);
+
+    // Tests for parallel sorts
+    RUN_TEST(test_parallel_merge_sort_matches_merge_sort);
+    RUN_TEST(test_inplace_merge_sort_matches_merge_sort);
+    RUN_TEST(test_sample_sort_skewed_keys);
+
+    // Tests for radix sort
+    RUN_TEST(test_radix_sort_pairs_keys);
+
+    // Tests for the sort of 64-bit integers
+    RUN_TEST(test_int64_sort_matches_merge_sort);
+    RUN_TEST(test_int64_key_pair_order);
+
+    // Tests for string sort
+    RUN_TEST(test_string_sort_prefixes);
+
+    // Tests for the CSV parser
+    RUN_TEST(test_parse_record_line_valid_and_malformed);
+    RUN_TEST(test_parse_record_line_float_matches_strtof);
+    RUN_TEST(test_csv_reader_read_all_threads);
+    RUN_TEST(test_csv_reader_read_all_compact_matches_records);
+    RUN_TEST(test_format_record_matches_printf);
+
+    // Tests for sort_records
+    RUN_TEST(test_sort_records_indirect_matches_direct);
+    RUN_TEST(test_sort_records_indirect_field2);
+    RUN_TEST(test_sort_records_auto_matches_merge);
+    RUN_TEST(test_sort_records_string_matches_merge);
+    RUN_TEST(test_sort_records_numeric_quick_matches_merge);
+    RUN_TEST(test_sort_records_external_matches_memory);
+    RUN_TEST(test_sort_records_skips_malformed_line);
+    RUN_TEST(test_sort_records_binary_matches_csv);
+    RUN_TEST(test_sort_record_array_field1_prefix_ties);
+    RUN_TEST(test_sort_record_array_concurrent_fields);
+    RUN_TEST(test_sort_records_multi_matches_single);
+    RUN_TEST(test_sort_records_compact_matches_records);
+    RUN_TEST(test_sort_records_limit_matches_prefix);
+    RUN_TEST(test_record_quantiles);
+
     // Tests for special cases
     RUN_TEST(test_sorting_already_sorted);
     RUN_TEST(test_sorting_reverse_sorted);
@@ -0,0 +1,227 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "thread_pool.h"
+
+// Initial capacity of a deque
+#define DEQUE_CAPACITY 64
+
+typedef struct {
+    void (*func)(void *);
+    void *arg;
+    TaskGroup *group;
+} Task;
+
+// Tasks of one thread: [head, tail) of a growable array. The owner pushes and pops
+// at the tail, thieves take from the head.
+typedef struct {
+    pthread_mutex_t lock;
+    Task *tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} Deque;
+
+struct ThreadPool {
+    size_t nthreads;
+    pthread_t *threads;       // The nthreads - 1 workers
+    Deque *deques;            // One per thread; deque 0 belongs to outside threads
+    atomic_size_t queued;     // Number of tasks sitting in the deques
+    int shutdown;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond; // Signalled when a task is queued or on shutdown
+};
+
+// Arguments of a worker thread
+typedef struct {
+    ThreadPool *pool;
+    size_t index;
+} WorkerArgs;
+
+// The pool and deque index of the current thread, if it is a worker
+static _Thread_local ThreadPool *current_pool = NULL;
+static _Thread_local size_t current_index = 0;
+
+// Index of the deque used by the calling thread
+static size_t self_index(const ThreadPool *pool) {
+    return current_pool == pool ? current_index : 0;
+}
+
+// Push a task at the bottom of a deque. Returns 0 on success, -1 if it cannot grow.
+static int deque_push(Deque *deque, Task task) {
+    int result = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail == deque->capacity) {
+        if (deque->head > 0) {
+            // Reuse the space freed by steals before growing
+            memmove(deque->tasks, deque->tasks + deque->head,
+                    sizeof(Task) * (deque->tail - deque->head));
+            deque->tail -= deque->head;
+            deque->head = 0;
+        } else {
+            Task *grown = realloc(deque->tasks, sizeof(Task) * deque->capacity * 2);
+            if (grown) {
+                deque->tasks = grown;
+                deque->capacity *= 2;
+            } else {
+                result = -1;
+            }
+        }
+    }
+    if (result == 0) deque->tasks[deque->tail++] = task;
+    pthread_mutex_unlock(&deque->lock);
+    return result;
+}
+
+// Take a task from the bottom (owner) or the top (thief) of a deque
+static int deque_take(Deque *deque, Task *task, int steal) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        *task = steal ? deque->tasks[deque->head++] : deque->tasks[--deque->tail];
+        if (deque->head == deque->tail) deque->head = deque->tail = 0;
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// Run one task: from the thread's own deque if possible, otherwise stolen from
+// another one. Returns 0 if no task was available.
+static int run_one_task(ThreadPool *pool, size_t self) {
+    Task task;
+    int found = deque_take(&pool->deques[self], &task, 0);
+    for (size_t k = 1; !found && k < pool->nthreads; k++) {
+        found = deque_take(&pool->deques[(self + k) % pool->nthreads], &task, 1);
+    }
+    if (!found) return 0;
+
+    atomic_fetch_sub(&pool->queued, 1);
+    task.func(task.arg);
+    atomic_fetch_sub(&task.group->pending, 1);
+    return 1;
+}
+
+// Main loop of a worker thread: run tasks, sleep while there are none
+static void *worker_main(void *arg) {
+    WorkerArgs *args = (WorkerArgs *)arg;
+    ThreadPool *pool = args->pool;
+    current_pool = pool;
+    current_index = args->index;
+    free(args);
+
+    for (;;) {
+        if (run_one_task(pool, current_index)) continue;
+
+        pthread_mutex_lock(&pool->idle_lock);
+        while (!pool->shutdown && atomic_load(&pool->queued) == 0) {
+            pthread_cond_wait(&pool->idle_cond, &pool->idle_lock);
+        }
+        int stop = pool->shutdown;
+        pthread_mutex_unlock(&pool->idle_lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+// Stop and join the first nworkers workers, then release the pool
+static void destroy_pool(ThreadPool *pool, size_t nworkers) {
+    pthread_mutex_lock(&pool->idle_lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_lock);
+
+    for (size_t i = 0; i < nworkers; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (size_t i = 0; i < pool->nthreads; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    pthread_mutex_destroy(&pool->idle_lock);
+    pthread_cond_destroy(&pool->idle_cond);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
+
+ThreadPool *thread_pool_create(size_t nthreads) {
+    if (nthreads < 1) nthreads = 1;
+
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+    pool->nthreads = nthreads;
+    pool->threads = malloc(sizeof(pthread_t) * nthreads);
+    pool->deques = calloc(nthreads, sizeof(Deque));
+    if (!pool->threads || !pool->deques) {
+        free(pool->threads);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+    atomic_init(&pool->queued, 0);
+    pthread_mutex_init(&pool->idle_lock, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+
+    int failed = 0;
+    for (size_t i = 0; i < nthreads; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].tasks = malloc(sizeof(Task) * DEQUE_CAPACITY);
+        pool->deques[i].capacity = DEQUE_CAPACITY;
+        if (!pool->deques[i].tasks) failed = 1;
+    }
+    if (failed) {
+        destroy_pool(pool, 0);
+        return NULL;
+    }
+
+    // Deque 0 is used by outside threads, workers get the other ones
+    for (size_t i = 0; i + 1 < nthreads; i++) {
+        WorkerArgs *args = malloc(sizeof(WorkerArgs));
+        if (args) {
+            args->pool = pool;
+            args->index = i + 1;
+        }
+        if (!args || pthread_create(&pool->threads[i], NULL, worker_main, args) != 0) {
+            free(args);
+            destroy_pool(pool, i);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void thread_pool_free(ThreadPool *pool) {
+    if (!pool) return;
+    destroy_pool(pool, pool->nthreads - 1);
+}
+
+size_t thread_pool_size(const ThreadPool *pool) {
+    return pool->nthreads;
+}
+
+void thread_pool_spawn(ThreadPool *pool, TaskGroup *group, void (*func)(void *), void *arg) {
+    Task task = {func, arg, group};
+
+    // Count the task before it becomes visible to other threads
+    atomic_fetch_add(&group->pending, 1);
+    atomic_fetch_add(&pool->queued, 1);
+    if (deque_push(&pool->deques[self_index(pool)], task) != 0) {
+        atomic_fetch_sub(&pool->queued, 1);
+        atomic_fetch_sub(&group->pending, 1);
+        func(arg);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->idle_lock);
+    pthread_cond_signal(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_lock);
+}
+
+void thread_pool_wait(ThreadPool *pool, TaskGroup *group) {
+    size_t self = self_index(pool);
+    while (atomic_load(&group->pending) > 0) {
+        if (!run_one_task(pool, self)) sched_yield();
+    }
+}
@@ -0,0 +1,457 @@
+#include <string.h>
+#include "sort.h"
+#include "sort_elem.h"
+
+// Arrays shorter than this are sorted with a single binary insertion sort
+#define MIN_MERGE 32
+// Initial number of consecutive wins before a merge switches to galloping
+#define MIN_GALLOP 7
+// Run lengths on the stack grow at least like Fibonacci numbers, so this is
+// enough for any array that fits in memory
+#define MAX_RUNS 96
+
+// Address of the i-th element of an array of elements of the given size
+#define ELEM(arr, i) ((arr) + (i) * size)
+
+// A pending run: arr[base .. base + len) is already sorted
+typedef struct {
+    size_t base;
+    size_t len;
+} Run;
+
+// State shared by all the merges of a single tim_sort() call
+typedef struct {
+    char *arr;
+    size_t size;
+    int (*compar)(const void *, const void *);
+    char *tmp;            // Scratch space for the shorter run of a merge
+    long min_gallop;      // Adaptive galloping threshold
+    Run runs[MAX_RUNS];   // Stack of pending runs
+    size_t nruns;
+} TimState;
+
+// Reverse the elements of arr[lo .. hi)
+static void reverse_range(char *arr, size_t lo, size_t hi, size_t size) {
+    while (lo + 1 < hi) {
+        hi--;
+        elem_swap(ELEM(arr, lo), ELEM(arr, hi), size);
+        lo++;
+    }
+}
+
+// Return the length of the run starting at arr[lo] (arr[lo .. hi) is the unsorted
+// part of the array). Strictly descending runs are reversed in place; descending
+// runs must be strict so that reversing them keeps the sort stable.
+static size_t count_run_and_make_ascending(char *arr, size_t lo, size_t hi, size_t size,
+                                           int (*compar)(const void *, const void *)) {
+    size_t run_hi = lo + 1;
+    if (run_hi == hi) return 1;
+
+    if (compar(ELEM(arr, run_hi), ELEM(arr, lo)) < 0) {
+        run_hi++;
+        while (run_hi < hi && compar(ELEM(arr, run_hi), ELEM(arr, run_hi - 1)) < 0) run_hi++;
+        reverse_range(arr, lo, run_hi, size);
+    } else {
+        run_hi++;
+        while (run_hi < hi && compar(ELEM(arr, run_hi), ELEM(arr, run_hi - 1)) >= 0) run_hi++;
+    }
+    return run_hi - lo;
+}
+
+// Sort arr[lo .. hi) by binary insertion, knowing that arr[lo .. start) is already sorted.
+// pivot is scratch space for one element.
+static void binary_insertion_sort(char *arr, size_t lo, size_t hi, size_t start, size_t size,
+                                  int (*compar)(const void *, const void *), char *pivot) {
+    for (; start < hi; start++) {
+        elem_copy(pivot, ELEM(arr, start), size);
+
+        // Find the rightmost position where pivot can go, to keep equal elements in order
+        size_t left = lo, right = start;
+        while (left < right) {
+            size_t mid = left + (right - left) / 2;
+            if (compar(pivot, ELEM(arr, mid)) < 0)
+                right = mid;
+            else
+                left = mid + 1;
+        }
+
+        memmove(ELEM(arr, left + 1), ELEM(arr, left), size * (start - left));
+        elem_copy(ELEM(arr, left), pivot, size);
+    }
+}
+
+// Minimum run length for an array of n elements: a number in [MIN_MERGE / 2, MIN_MERGE]
+// such that n / min_run is close to, but no more than, a power of two
+static size_t min_run_length(size_t n) {
+    size_t r = 0;
+    while (n >= MIN_MERGE) {
+        r |= n & 1;
+        n >>= 1;
+    }
+    return n + r;
+}
+
+// Locate the leftmost position in the sorted run[0 .. len) where key could be inserted,
+// i.e. the k such that run[k - 1] < key <= run[k]. The search gallops outwards from hint.
+static size_t gallop_left(const char *key, const char *run, size_t len, size_t hint, size_t size,
+                          int (*compar)(const void *, const void *)) {
+    size_t last_ofs = 0, ofs = 1;
+
+    if (compar(key, ELEM(run, hint)) > 0) {
+        // Gallop right until run[hint + last_ofs] < key <= run[hint + ofs]
+        size_t max_ofs = len - hint;
+        while (ofs < max_ofs && compar(key, ELEM(run, hint + ofs)) > 0) {
+            last_ofs = ofs;
+            ofs = 2 * ofs + 1;
+        }
+        if (ofs > max_ofs) ofs = max_ofs;
+        last_ofs += hint;
+        ofs += hint;
+    } else {
+        // Gallop left until run[hint - ofs] < key <= run[hint - last_ofs]
+        size_t max_ofs = hint + 1;
+        while (ofs < max_ofs && compar(key, ELEM(run, hint - ofs)) <= 0) {
+            last_ofs = ofs;
+            ofs = 2 * ofs + 1;
+        }
+        if (ofs > max_ofs) ofs = max_ofs;
+        size_t tmp = last_ofs;
+        last_ofs = hint - ofs;  // May wrap around to "-1", undone by the increment below
+        ofs = hint - tmp;
+    }
+
+    // Binary search in (last_ofs, ofs]
+    last_ofs++;
+    while (last_ofs < ofs) {
+        size_t mid = last_ofs + (ofs - last_ofs) / 2;
+        if (compar(key, ELEM(run, mid)) > 0)
+            last_ofs = mid + 1;
+        else
+            ofs = mid;
+    }
+    return ofs;
+}
+
+// Like gallop_left, but return the rightmost position: run[k - 1] <= key < run[k]
+static size_t gallop_right(const char *key, const char *run, size_t len, size_t hint, size_t size,
+                           int (*compar)(const void *, const void *)) {
+    size_t last_ofs = 0, ofs = 1;
+
+    if (compar(key, ELEM(run, hint)) < 0) {
+        // Gallop left until run[hint - ofs] <= key < run[hint - last_ofs]
+        size_t max_ofs = hint + 1;
+        while (ofs < max_ofs && compar(key, ELEM(run, hint - ofs)) < 0) {
+            last_ofs = ofs;
+            ofs = 2 * ofs + 1;
+        }
+        if (ofs > max_ofs) ofs = max_ofs;
+        size_t tmp = last_ofs;
+        last_ofs = hint - ofs;  // May wrap around to "-1", undone by the increment below
+        ofs = hint - tmp;
+    } else {
+        // Gallop right until run[hint + last_ofs] <= key < run[hint + ofs]
+        size_t max_ofs = len - hint;
+        while (ofs < max_ofs && compar(key, ELEM(run, hint + ofs)) >= 0) {
+            last_ofs = ofs;
+            ofs = 2 * ofs + 1;
+        }
+        if (ofs > max_ofs) ofs = max_ofs;
+        last_ofs += hint;
+        ofs += hint;
+    }
+
+    // Binary search in (last_ofs, ofs]
+    last_ofs++;
+    while (last_ofs < ofs) {
+        size_t mid = last_ofs + (ofs - last_ofs) / 2;
+        if (compar(key, ELEM(run, mid)) < 0)
+            ofs = mid;
+        else
+            last_ofs = mid + 1;
+    }
+    return ofs;
+}
+
+// Merge the adjacent runs arr[base1 .. base1 + len1) and arr[base2 .. base2 + len2),
+// with len1 <= len2, working from the left. The first run is moved to the scratch
+// buffer. Requires arr[base2] < arr[base1] and arr[base1 + len1 - 1] > last of run 2.
+static void merge_lo(TimState *ts, size_t base1, size_t len1, size_t base2, size_t len2) {
+    size_t size = ts->size;
+    int (*compar)(const void *, const void *) = ts->compar;
+    char *arr = ts->arr;
+    char *tmp = ts->tmp;
+    memcpy(tmp, ELEM(arr, base1), size * len1);
+
+    size_t cursor1 = 0, cursor2 = base2, dest = base1;
+    long min_gallop = ts->min_gallop;
+
+    elem_copy(ELEM(arr, dest++), ELEM(arr, cursor2++), size);
+    if (--len2 == 0) {
+        memcpy(ELEM(arr, dest), ELEM(tmp, cursor1), size * len1);
+        return;
+    }
+    if (len1 == 1) {
+        memmove(ELEM(arr, dest), ELEM(arr, cursor2), size * len2);
+        elem_copy(ELEM(arr, dest + len2), ELEM(tmp, cursor1), size);
+        return;
+    }
+
+    for (;;) {
+        size_t count1 = 0, count2 = 0;
+
+        // One element at a time until one run keeps winning
+        do {
+            if (compar(ELEM(arr, cursor2), ELEM(tmp, cursor1)) < 0) {
+                elem_copy(ELEM(arr, dest++), ELEM(arr, cursor2++), size);
+                count2++;
+                count1 = 0;
+                if (--len2 == 0) goto done;
+            } else {
+                elem_copy(ELEM(arr, dest++), ELEM(tmp, cursor1++), size);
+                count1++;
+                count2 = 0;
+                if (--len1 == 1) goto done;
+            }
+        } while ((long)(count1 | count2) < min_gallop);
+
+        // Gallop: copy whole blocks while the winning streaks stay long
+        do {
+            count1 = gallop_right(ELEM(arr, cursor2), ELEM(tmp, cursor1), len1, 0, size, compar);
+            if (count1 != 0) {
+                memcpy(ELEM(arr, dest), ELEM(tmp, cursor1), size * count1);
+                dest += count1;
+                cursor1 += count1;
+                len1 -= count1;
+                if (len1 <= 1) goto done;
+            }
+            elem_copy(ELEM(arr, dest++), ELEM(arr, cursor2++), size);
+            if (--len2 == 0) goto done;
+
+            count2 = gallop_left(ELEM(tmp, cursor1), ELEM(arr, cursor2), len2, 0, size, compar);
+            if (count2 != 0) {
+                memmove(ELEM(arr, dest), ELEM(arr, cursor2), size * count2);
+                dest += count2;
+                cursor2 += count2;
+                len2 -= count2;
+                if (len2 == 0) goto done;
+            }
+            elem_copy(ELEM(arr, dest++), ELEM(tmp, cursor1++), size);
+            if (--len1 == 1) goto done;
+
+            min_gallop--;
+        } while (count1 >= MIN_GALLOP || count2 >= MIN_GALLOP);
+
+        // Galloping stopped paying off: make it harder to enter again
+        if (min_gallop < 0) min_gallop = 0;
+        min_gallop += 2;
+    }
+
+done:
+    ts->min_gallop = min_gallop < 1 ? 1 : min_gallop;
+    if (len1 == 1) {
+        memmove(ELEM(arr, dest), ELEM(arr, cursor2), size * len2);
+        elem_copy(ELEM(arr, dest + len2), ELEM(tmp, cursor1), size);
+    } else {
+        memcpy(ELEM(arr, dest), ELEM(tmp, cursor1), size * len1);
+    }
+}
+
+// Mirror image of merge_lo for len1 >= len2: the second run is moved to the scratch
+// buffer and the merge proceeds from the right.
+static void merge_hi(TimState *ts, size_t base1, size_t len1, size_t base2, size_t len2) {
+    size_t size = ts->size;
+    int (*compar)(const void *, const void *) = ts->compar;
+    char *arr = ts->arr;
+    char *tmp = ts->tmp;
+    memcpy(tmp, ELEM(arr, base2), size * len2);
+
+    // Cursors may step one position past the start of their run ("-1" after wrap
+    // around), but are only dereferenced while the run is non-empty
+    size_t cursor1 = base1 + len1 - 1, cursor2 = len2 - 1, dest = base2 + len2 - 1;
+    long min_gallop = ts->min_gallop;
+
+    elem_copy(ELEM(arr, dest--), ELEM(arr, cursor1--), size);
+    if (--len1 == 0) {
+        memcpy(ELEM(arr, dest + 1 - len2), tmp, size * len2);
+        return;
+    }
+    if (len2 == 1) {
+        dest -= len1;
+        cursor1 -= len1;
+        memmove(ELEM(arr, dest + 1), ELEM(arr, cursor1 + 1), size * len1);
+        elem_copy(ELEM(arr, dest), ELEM(tmp, cursor2), size);
+        return;
+    }
+
+    for (;;) {
+        size_t count1 = 0, count2 = 0;
+
+        // One element at a time until one run keeps winning
+        do {
+            if (compar(ELEM(tmp, cursor2), ELEM(arr, cursor1)) < 0) {
+                elem_copy(ELEM(arr, dest--), ELEM(arr, cursor1--), size);
+                count1++;
+                count2 = 0;
+                if (--len1 == 0) goto done;
+            } else {
+                elem_copy(ELEM(arr, dest--), ELEM(tmp, cursor2--), size);
+                count2++;
+                count1 = 0;
+                if (--len2 == 1) goto done;
+            }
+        } while ((long)(count1 | count2) < min_gallop);
+
+        // Gallop: copy whole blocks while the winning streaks stay long
+        do {
+            count1 = len1 - gallop_right(ELEM(tmp, cursor2), ELEM(arr, base1), len1, len1 - 1,
+                                         size, compar);
+            if (count1 != 0) {
+                dest -= count1;
+                cursor1 -= count1;
+                len1 -= count1;
+                memmove(ELEM(arr, dest + 1), ELEM(arr, cursor1 + 1), size * count1);
+                if (len1 == 0) goto done;
+            }
+            elem_copy(ELEM(arr, dest--), ELEM(tmp, cursor2--), size);
+            if (--len2 == 1) goto done;
+
+            count2 = len2 - gallop_left(ELEM(arr, cursor1), tmp, len2, len2 - 1, size, compar);
+            if (count2 != 0) {
+                dest -= count2;
+                cursor2 -= count2;
+                len2 -= count2;
+                memcpy(ELEM(arr, dest + 1), ELEM(tmp, cursor2 + 1), size * count2);
+                if (len2 <= 1) goto done;
+            }
+            elem_copy(ELEM(arr, dest--), ELEM(arr, cursor1--), size);
+            if (--len1 == 0) goto done;
+
+            min_gallop--;
+        } while (count1 >= MIN_GALLOP || count2 >= MIN_GALLOP);
+
+        // Galloping stopped paying off: make it harder to enter again
+        if (min_gallop < 0) min_gallop = 0;
+        min_gallop += 2;
+    }
+
+done:
+    ts->min_gallop = min_gallop < 1 ? 1 : min_gallop;
+    if (len2 == 1) {
+        dest -= len1;
+        cursor1 -= len1;
+        memmove(ELEM(arr, dest + 1), ELEM(arr, cursor1 + 1), size * len1);
+        elem_copy(ELEM(arr, dest), ELEM(tmp, cursor2), size);
+    } else {
+        memcpy(ELEM(arr, dest + 1 - len2), tmp, size * len2);
+    }
+}
+
+// Merge the runs at stack positions i and i + 1 (i is the second or third from the top)
+static void merge_at(TimState *ts, size_t i) {
+    size_t size = ts->size;
+    int (*compar)(const void *, const void *) = ts->compar;
+    char *arr = ts->arr;
+    size_t base1 = ts->runs[i].base, len1 = ts->runs[i].len;
+    size_t base2 = ts->runs[i + 1].base, len2 = ts->runs[i + 1].len;
+
+    // Record the merged run; if i is the third-from-top run, slide the top one down
+    ts->runs[i].len = len1 + len2;
+    if (i + 3 == ts->nruns) ts->runs[i + 1] = ts->runs[i + 2];
+    ts->nruns--;
+
+    // Elements of run 1 that are already in place can be skipped
+    size_t k = gallop_right(ELEM(arr, base2), ELEM(arr, base1), len1, 0, size, compar);
+    base1 += k;
+    len1 -= k;
+    if (len1 == 0) return;
+
+    // So can elements of run 2 that are already in place
+    len2 = gallop_left(ELEM(arr, base1 + len1 - 1), ELEM(arr, base2), len2, len2 - 1, size, compar);
+    if (len2 == 0) return;
+
+    if (len1 <= len2)
+        merge_lo(ts, base1, len1, base2, len2);
+    else
+        merge_hi(ts, base1, len1, base2, len2);
+}
+
+// Merge runs until the stack invariants hold again:
+// len[i - 2] > len[i - 1] + len[i] and len[i - 1] > len[i] for the top runs
+static void merge_collapse(TimState *ts) {
+    Run *runs = ts->runs;
+    while (ts->nruns > 1) {
+        size_t n = ts->nruns - 2;
+        if ((n > 0 && runs[n - 1].len <= runs[n].len + runs[n + 1].len) ||
+            (n > 1 && runs[n - 2].len <= runs[n - 1].len + runs[n].len)) {
+            if (runs[n - 1].len < runs[n + 1].len) n--;
+        } else if (runs[n].len > runs[n + 1].len) {
+            break;
+        }
+        merge_at(ts, n);
+    }
+}
+
+// Merge all the remaining runs into one
+static void merge_force_collapse(TimState *ts) {
+    Run *runs = ts->runs;
+    while (ts->nruns > 1) {
+        size_t n = ts->nruns - 2;
+        if (n > 0 && runs[n - 1].len < runs[n + 1].len) n--;
+        merge_at(ts, n);
+    }
+}
+
+// TimSort: natural merge sort over detected runs
+void tim_sort(void *base, size_t nitems, size_t size,
+              int (*compar)(const void *, const void *)) {
+    // Base case: if the array has 0 or 1 item, or invalid parameters
+    if (nitems < 2 || base == NULL || size == 0 || compar == NULL) return;
+    char *arr = (char *)base;
+
+    // A merge never needs more than half of the array in scratch space, and binary
+    // insertion sort takes its pivot slot from there too. Without it, sort in place.
+    TimState ts;
+    ts.arr = arr;
+    ts.size = size;
+    ts.compar = compar;
+    ts.tmp = malloc(size * (nitems < MIN_MERGE ? 1 : nitems / 2));
+    ts.min_gallop = MIN_GALLOP;
+    ts.nruns = 0;
+    if (!ts.tmp) {
+        SortCompar cmp = {compar, NULL, NULL};
+        inplace_merge_sort_with(base, nitems, size, &cmp);
+        return;
+    }
+
+    // Small arrays: one run extended with binary insertion sort, no merging
+    if (nitems < MIN_MERGE) {
+        size_t run_len = count_run_and_make_ascending(arr, 0, nitems, size, compar);
+        binary_insertion_sort(arr, 0, nitems, run_len, size, compar, ts.tmp);
+        free(ts.tmp);
+        return;
+    }
+
+    size_t min_run = min_run_length(nitems);
+    size_t lo = 0, remaining = nitems;
+    do {
+        // Find the next run, extending it to min_run elements if it is too short
+        size_t run_len = count_run_and_make_ascending(arr, lo, nitems, size, compar);
+        if (run_len < min_run) {
+            size_t force = remaining < min_run ? remaining : min_run;
+            binary_insertion_sort(arr, lo, lo + force, lo + run_len, size, compar, ts.tmp);
+            run_len = force;
+        }
+
+        // Push the run and merge while the stack invariants are violated
+        ts.runs[ts.nruns].base = lo;
+        ts.runs[ts.nruns].len = run_len;
+        ts.nruns++;
+        merge_collapse(&ts);
+
+        lo += run_len;
+        remaining -= run_len;
+    } while (remaining != 0);
+
+    merge_force_collapse(&ts);
+    free(ts.tmp);
+}
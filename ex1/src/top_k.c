@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "csv_writer.h"
+#include "record_stream.h"
+#include "top_k.h"
+
+// Records read from the input at a time
+#define TOP_K_CHUNK 4096
+
+// The smallest records seen so far, kept in slots that never move. The heap orders
+// the slots with the largest record (the last in the output) at the root.
+typedef struct {
+    Record *records;        // The kept records
+    uint64_t *positions;    // Input position of each kept record, which breaks ties
+    size_t *heap;           // Slots in max-heap order
+    size_t count;           // Slots in use
+    size_t capacity;        // Slots allocated, up to limit
+    size_t limit;           // Number of records to keep
+    RecordCompar compar;    // Comparator of the sort field
+} TopK;
+
+// Whether the record of slot a comes after the one of slot b in the output
+static int slot_after(const TopK *top, size_t a, size_t b) {
+    int cmp = top->compar(&top->records[a], &top->records[b]);
+    return cmp > 0 || (cmp == 0 && top->positions[a] > top->positions[b]);
+}
+
+// Move the slot at heap index node up to its place
+static void sift_up(TopK *top, size_t node) {
+    size_t *heap = top->heap;
+    while (node > 0) {
+        size_t parent = (node - 1) / 2;
+        if (!slot_after(top, heap[node], heap[parent])) return;
+        size_t tmp = heap[node];
+        heap[node] = heap[parent];
+        heap[parent] = tmp;
+        node = parent;
+    }
+}
+
+// Move the slot at heap index root down to its place among the first count ones
+static void sift_down(TopK *top, size_t root, size_t count) {
+    size_t *heap = top->heap;
+    size_t child;
+    while ((child = 2 * root + 1) < count) {
+        if (child + 1 < count && slot_after(top, heap[child + 1], heap[child])) child++;
+        if (!slot_after(top, heap[child], heap[root])) return;
+        size_t tmp = heap[root];
+        heap[root] = heap[child];
+        heap[child] = tmp;
+        root = child;
+    }
+}
+
+// Double the slots, up to the limit. Returns 0 on success, -1 if memory runs out.
+static int top_k_grow(TopK *top) {
+    size_t capacity = top->capacity * 2 < top->limit ? top->capacity * 2 : top->limit;
+    Record *records = realloc(top->records, sizeof(Record) * capacity);
+    if (records) top->records = records;
+    uint64_t *positions = realloc(top->positions, sizeof(uint64_t) * capacity);
+    if (positions) top->positions = positions;
+    size_t *heap = realloc(top->heap, sizeof(size_t) * capacity);
+    if (heap) top->heap = heap;
+    if (!records || !positions || !heap) return -1;
+    top->capacity = capacity;
+    return 0;
+}
+
+// Offer the record found at the given position of the input. Returns 0 on success,
+// -1 if memory runs out.
+static int top_k_offer(TopK *top, const Record *record, uint64_t position) {
+    if (top->count < top->limit) {
+        if (top->count == top->capacity && top_k_grow(top) != 0) return -1;
+        size_t slot = top->count++;
+        top->records[slot] = *record;
+        top->positions[slot] = position;
+        top->heap[slot] = slot;
+        sift_up(top, slot);
+    } else if (top->compar(record, &top->records[top->heap[0]]) < 0) {
+        // A record comes later in the input than all the kept ones, so on a tie it
+        // loses: only a strictly smaller one replaces the root
+        size_t slot = top->heap[0];
+        top->records[slot] = *record;
+        top->positions[slot] = position;
+        sift_down(top, 0, top->count);
+    }
+    return 0;
+}
+
+// Function to write the first records of a file in sorted order
+int top_k_records(FILE *infile, FILE *outfile, const SortOptions *options) {
+    TopK top = {NULL, NULL, NULL, 0, 0, options->limit, record_comparator(options->field)};
+    top.capacity = options->limit < TOP_K_CHUNK ? options->limit : TOP_K_CHUNK;
+    top.records = malloc(sizeof(Record) * top.capacity);
+    top.positions = malloc(sizeof(uint64_t) * top.capacity);
+    top.heap = malloc(sizeof(size_t) * top.capacity);
+    Record *chunk = malloc(sizeof(Record) * TOP_K_CHUNK);
+    int result = top.records && top.positions && top.heap && chunk ? 0 : -1;
+
+    RecordStream stream;
+    if (result == 0 && record_stream_open(&stream, infile) != 0) result = -1;
+    if (result == 0) {
+        uint64_t position = 0;
+        size_t count;
+        do {
+            count = record_stream_read(&stream, chunk, TOP_K_CHUNK);
+            for (size_t i = 0; result == 0 && i < count; i++) {
+                result = top_k_offer(&top, &chunk[i], position++);
+            }
+        } while (result == 0 && count == TOP_K_CHUNK);
+        record_stream_close(&stream);
+    }
+
+    if (result == 0) {
+        // Heap sort the slots: the largest record goes last, and so on
+        for (size_t end = top.count; end > 1; end--) {
+            size_t tmp = top.heap[0];
+            top.heap[0] = top.heap[end - 1];
+            top.heap[end - 1] = tmp;
+            sift_down(&top, 0, end - 1);
+        }
+
+        CsvWriter writer;
+        csv_writer_open(&writer, outfile);
+        for (size_t i = 0; i < top.count; i++) csv_writer_put(&writer, &top.records[top.heap[i]]);
+        if (csv_writer_close(&writer) != 0) result = -1;
+    }
+
+    free(chunk);
+    free(top.records);
+    free(top.positions);
+    free(top.heap);
+    return result;
+}